@@ -0,0 +1,12 @@
+# Headless runner for the descent methods; needs neither Qt nor a display.
+# build with: qmake cli/cli.pro && make
+
+TEMPLATE = app
+TARGET = gradient_descent_cli
+
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+
+include(../core.pri)
+
+SOURCES += main.cpp
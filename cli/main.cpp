@@ -0,0 +1,529 @@
+// Command-line runner for the descent methods. Runs a batch of starting
+// points on one surface with one method as fast as possible and writes the
+// trajectories and summary statistics, or sweeps the hyperparameters of a
+// method on all cores. Needs no display; see --help.
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "batch_descent.h"
+#include "batch_kernels.h"
+#include "expression.h"
+#include "heightmap.h"
+#include "gradient_descent.h"
+#include "sweep.h"
+#include "trajectory_file.h"
+#include "thread_pool.h"
+
+namespace {
+
+const double kPlotMin = -2.;
+const double kPlotMax = 2.;
+
+struct Options {
+    Function::FunctionName function_name = Function::local_minimum;
+    Optimizer::OptimizerName optimizer_name = Optimizer::vanilla;
+    Hyperparameters hyperparameters;
+    std::string heightmap_path;
+    int heightmap_width = 0; // 0: square
+    std::vector<Point> starting_points;
+    int max_steps = 100000;
+    std::string trajectory_path;
+    std::string binary_trajectory_path;
+    int trajectory_interval = 1;
+    std::string summary_path;
+
+    // a sweep runs if any of its lists is given
+    SweepSpace sweep_space;
+    int sweep_samples = 0; // 0: the full grid
+    unsigned seed = 1;
+    int num_threads = 0;
+    std::string sweep_path;
+
+    bool isSweep() const{
+        const SweepSpace& s = sweep_space;
+        return sweep_samples > 0 || !s.function_names.empty() ||
+                !s.learning_rates.empty() || !s.decay_rates.empty() ||
+                !s.discount_factors.empty() || !s.squared_discount_factors.empty() ||
+                !s.beta1s.empty() || !s.beta2s.empty();
+    }
+};
+
+
+void printUsage(){
+    printf(
+        "usage: gradient_descent_cli [options]\n"
+        "\n"
+        "  --surface NAME            local_minimum (default), global_minimum, saddle_point,\n"
+        "                            ecliptic_bowl, hills, plateau, custom\n"
+        "  --expression TEXT         the custom surface, e.g. \"x^2 + 10*sin(z)\"; implies\n"
+        "                            --surface custom\n"
+        "  --heightmap FILE          a grid of raw float32 heights spanning the plotted\n"
+        "                            area, row after row along z; implies --surface heightmap\n"
+        "  --heightmap-width N       its width if it isn't square\n"
+        "  --optimizer NAME          vanilla (default), momentum, qhm, ada_grad, rms_prop,\n"
+        "                            adam, qhadam\n"
+        "  --learning-rate X         hyperparameters; defaults are those of the app\n"
+        "  --decay-rate X\n"
+        "  --discount-factor X\n"
+        "  --squared-discount-factor X\n"
+        "  --beta1 X\n"
+        "  --beta2 X\n"
+        "  --no-bias-correction\n"
+        "  --start X,Z               starting point; repeat for more balls\n"
+        "  --grid N                  N x N starting points over the plotted area\n"
+        "  --max-steps N             stop after N steps (default 100000)\n"
+        "  --finite-difference       finite difference instead of analytic gradients\n"
+        "  --instruction-set NAME    scalar, avx2 or avx512 (default: best available)\n"
+        "  --trajectory FILE         write ball,step,x,z,loss rows as csv\n"
+        "  --binary-trajectory FILE  write the trajectories in the compact binary format\n"
+        "                            the app can load (see trajectory_file.h)\n"
+        "  --trajectory-interval N   only write every Nth step (default 1)\n"
+        "  --summary FILE            write the final state of every ball as csv\n"
+        "\n"
+        "sweep: run every combination of the listed values (comma separated) from\n"
+        "the starting points above, on all cores\n"
+        "\n"
+        "  --sweep-surface LIST\n"
+        "  --sweep-learning-rate LIST\n"
+        "  --sweep-decay-rate LIST\n"
+        "  --sweep-discount-factor LIST\n"
+        "  --sweep-squared-discount-factor LIST\n"
+        "  --sweep-beta1 LIST\n"
+        "  --sweep-beta2 LIST\n"
+        "  --sweep-random N          N random configurations within the range of\n"
+        "                            each list instead of the full grid\n"
+        "  --seed N                  seed for --sweep-random (default 1)\n"
+        "  --threads N               worker threads (default: one per core)\n"
+        "  --sweep-output FILE       write the results as csv (default: stdout)\n");
+}
+
+
+bool parseDouble(const char* text, double& value){
+    char* end = nullptr;
+    value = strtod(text, &end);
+    return end != text && *end == '\0';
+}
+
+
+bool parseInt(const char* text, int& value){
+    char* end = nullptr;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE) return false;
+    if (parsed < INT_MIN || parsed > INT_MAX) return false;
+    value = int(parsed);
+    return true;
+}
+
+
+bool parseList(const char* text, std::vector<double>& values){
+    std::string list = text;
+    size_t begin = 0;
+    while (true){
+        size_t end = list.find(',', begin);
+        double value;
+        if (!parseDouble(list.substr(begin, end - begin).c_str(), value)) return false;
+        values.push_back(value);
+        if (end == std::string::npos) return true;
+        begin = end + 1;
+    }
+}
+
+
+bool parseSurfaceList(const char* text, std::vector<Function::FunctionName>& names){
+    std::string list = text;
+    size_t begin = 0;
+    while (true){
+        size_t end = list.find(',', begin);
+        Function::FunctionName name;
+        if (!Surface::functionFromName(list.substr(begin, end - begin), name)) return false;
+        names.push_back(name);
+        if (end == std::string::npos) return true;
+        begin = end + 1;
+    }
+}
+
+
+bool parsePoint(const char* text, Point& p){
+    const char* comma = strchr(text, ',');
+    if (comma == nullptr) return false;
+    return parseDouble(std::string(text, comma).c_str(), p.x) &&
+           parseDouble(comma + 1, p.z);
+}
+
+
+bool parseArguments(int argc, char** argv, Options& options){
+    // the optimizer decides the default hyperparameters, so find it first
+    for (int i = 1; i + 1 < argc; i++){
+        if (strcmp(argv[i], "--optimizer") == 0 &&
+            !Optimizer::fromName(argv[i + 1], options.optimizer_name)){
+            fprintf(stderr, "unknown optimizer: %s\n", argv[i + 1]);
+            return false;
+        }
+    }
+    options.hyperparameters =
+            GradientDescent::create(options.optimizer_name)->hyperparameters();
+
+    Hyperparameters& h = options.hyperparameters;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        const char* value = has_value ? argv[i + 1] : "";
+        bool ok = true;
+
+        if (arg == "--help" || arg == "-h"){
+            printUsage();
+            exit(0);
+        } else if (arg == "--no-bias-correction"){
+            h.use_bias_correction = false;
+            continue;
+        } else if (arg == "--finite-difference"){
+            GradientDescent::gradient_method = Gradient::finite_difference;
+            continue;
+        } else if (!has_value){
+            fprintf(stderr, "unknown option or missing value: %s\n", arg.c_str());
+            return false;
+        }
+
+        if (arg == "--surface"){
+            ok = Surface::functionFromName(value, options.function_name);
+        } else if (arg == "--expression"){
+            std::string error;
+            std::shared_ptr<const Expression> expression = Expression::compile(value, error);
+            if (expression == nullptr){
+                fprintf(stderr, "invalid expression: %s\n", error.c_str());
+                return false;
+            }
+            Surface::setCustomExpression(expression);
+            options.function_name = Function::custom;
+        } else if (arg == "--heightmap"){
+            options.heightmap_path = value;
+            options.function_name = Function::heightmap;
+        } else if (arg == "--heightmap-width"){
+            ok = parseInt(value, options.heightmap_width) && options.heightmap_width > 1;
+        } else if (arg == "--optimizer"){
+            // handled above
+        } else if (arg == "--learning-rate"){
+            ok = parseDouble(value, h.learning_rate);
+        } else if (arg == "--decay-rate"){
+            ok = parseDouble(value, h.decay_rate);
+        } else if (arg == "--discount-factor"){
+            ok = parseDouble(value, h.discount_factor);
+        } else if (arg == "--squared-discount-factor"){
+            ok = parseDouble(value, h.squared_discount_factor);
+        } else if (arg == "--beta1"){
+            ok = parseDouble(value, h.beta1);
+        } else if (arg == "--beta2"){
+            ok = parseDouble(value, h.beta2);
+        } else if (arg == "--start"){
+            Point p;
+            ok = parsePoint(value, p);
+            options.starting_points.push_back(p);
+        } else if (arg == "--grid"){
+            int n = 0;
+            ok = parseInt(value, n) && n > 0;
+            for (int i = 0; ok && i < n; i++){
+                for (int j = 0; j < n; j++){
+                    double step = n > 1 ? (kPlotMax - kPlotMin) / (n - 1) : 0.;
+                    options.starting_points.push_back(
+                                Point(kPlotMin + j * step, kPlotMin + i * step));
+                }
+            }
+        } else if (arg == "--max-steps"){
+            ok = parseInt(value, options.max_steps) && options.max_steps > 0;
+        } else if (arg == "--instruction-set"){
+            std::string name = value;
+            if (name == "scalar") BatchKernels::setInstructionSet(BatchKernels::scalar);
+            else if (name == "avx2") BatchKernels::setInstructionSet(BatchKernels::avx2);
+            else if (name == "avx512") BatchKernels::setInstructionSet(BatchKernels::avx512);
+            else ok = false;
+        } else if (arg == "--trajectory"){
+            options.trajectory_path = value;
+        } else if (arg == "--binary-trajectory"){
+            options.binary_trajectory_path = value;
+        } else if (arg == "--trajectory-interval"){
+            ok = parseInt(value, options.trajectory_interval) &&
+                 options.trajectory_interval > 0;
+        } else if (arg == "--summary"){
+            options.summary_path = value;
+        } else if (arg == "--sweep-surface"){
+            ok = parseSurfaceList(value, options.sweep_space.function_names);
+        } else if (arg == "--sweep-learning-rate"){
+            ok = parseList(value, options.sweep_space.learning_rates);
+        } else if (arg == "--sweep-decay-rate"){
+            ok = parseList(value, options.sweep_space.decay_rates);
+        } else if (arg == "--sweep-discount-factor"){
+            ok = parseList(value, options.sweep_space.discount_factors);
+        } else if (arg == "--sweep-squared-discount-factor"){
+            ok = parseList(value, options.sweep_space.squared_discount_factors);
+        } else if (arg == "--sweep-beta1"){
+            ok = parseList(value, options.sweep_space.beta1s);
+        } else if (arg == "--sweep-beta2"){
+            ok = parseList(value, options.sweep_space.beta2s);
+        } else if (arg == "--sweep-random"){
+            ok = parseInt(value, options.sweep_samples) && options.sweep_samples > 0;
+        } else if (arg == "--seed"){
+            int seed = 0;
+            ok = parseInt(value, seed) && seed >= 0;
+            options.seed = unsigned(seed);
+        } else if (arg == "--threads"){
+            ok = parseInt(value, options.num_threads) && options.num_threads > 0;
+        } else if (arg == "--sweep-output"){
+            options.sweep_path = value;
+        } else{
+            fprintf(stderr, "unknown option: %s\n", arg.c_str());
+            return false;
+        }
+
+        if (!ok){
+            fprintf(stderr, "invalid value for %s: %s\n", arg.c_str(), value);
+            return false;
+        }
+        i++;
+    }
+
+    if (options.isSweep() && (!options.trajectory_path.empty() ||
+                              !options.binary_trajectory_path.empty() ||
+                              !options.summary_path.empty())){
+        fprintf(stderr, "--trajectory, --binary-trajectory and --summary don't apply to "
+                        "a sweep; its results go to --sweep-output\n");
+        return false;
+    }
+    const std::vector<Function::FunctionName>& sweep_surfaces =
+            options.sweep_space.function_names;
+    bool uses_heightmap = options.function_name == Function::heightmap ||
+            std::find(sweep_surfaces.begin(), sweep_surfaces.end(),
+                      Function::heightmap) != sweep_surfaces.end();
+    if (uses_heightmap && options.heightmap_path.empty()){
+        fprintf(stderr, "the heightmap surface needs --heightmap FILE\n");
+        return false;
+    }
+    if (!options.heightmap_path.empty()){
+        std::string error;
+        std::shared_ptr<const Heightmap> heightmap = Heightmap::openRaw(
+                    options.heightmap_path, size_t(options.heightmap_width), error);
+        if (heightmap == nullptr){
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        Surface::setHeightmap(heightmap);
+    }
+    if (options.starting_points.empty()){
+        // same default as the app
+        double start = (7 * kPlotMax + kPlotMin) / 8;
+        options.starting_points.push_back(Point(start, start));
+    }
+    return true;
+}
+
+
+// a row for every ball that moved since its last row, which written_steps
+// (the step of each ball's last row, -1 for none) keeps track of
+void writeTrajectoryRows(FILE* file, const BatchGradientDescent& descent,
+                         std::vector<int>& written_steps){
+    const BatchState& state = descent.batchState();
+    std::vector<double> losses = descent.losses();
+    for (size_t i = 0; i < descent.size(); i++){
+        if (state.num_steps[i] == written_steps[i]) continue;
+        fprintf(file, "%zu,%d,%.17g,%.17g,%.17g\n", i, state.num_steps[i],
+                state.x[i], state.z[i], losses[i]);
+        written_steps[i] = state.num_steps[i];
+    }
+}
+
+
+void writeSummary(FILE* file, const BatchGradientDescent& descent,
+                  const std::vector<Point>& starting_points){
+    const BatchState& state = descent.batchState();
+    std::vector<double> losses = descent.losses();
+    fprintf(file, "ball,start_x,start_z,x,z,loss,steps,converged\n");
+    for (size_t i = 0; i < descent.size(); i++){
+        fprintf(file, "%zu,%.17g,%.17g,%.17g,%.17g,%.17g,%d,%d\n", i,
+                starting_points[i].x, starting_points[i].z, state.x[i], state.z[i],
+                losses[i], state.num_steps[i],
+                int(state.converged[i]));
+    }
+}
+
+
+void printStatistics(const Options& options, const BatchGradientDescent& descent,
+                     double seconds){
+    const BatchState& state = descent.batchState();
+    size_t num_converged = descent.numConverged();
+    long long total_steps = 0;
+    int min_steps = options.max_steps, max_steps = 0;
+    double min_loss = 0., max_loss = 0., sum_loss = 0.;
+    std::vector<double> losses = descent.losses();
+    for (size_t i = 0; i < descent.size(); i++){
+        total_steps += state.num_steps[i];
+        if (state.converged[i]){
+            min_steps = std::min(min_steps, state.num_steps[i]);
+            max_steps = std::max(max_steps, state.num_steps[i]);
+        }
+        double loss = losses[i];
+        min_loss = i == 0 ? loss : std::min(min_loss, loss);
+        max_loss = i == 0 ? loss : std::max(max_loss, loss);
+        sum_loss += loss;
+    }
+
+    printf("surface:          %s\n", Surface::functionName(options.function_name));
+    printf("optimizer:        %s\n", Optimizer::name(options.optimizer_name));
+    printf("instruction set:  %s\n",
+           BatchKernels::instructionSetName(BatchKernels::instructionSet()));
+    printf("balls:            %zu\n", descent.size());
+    printf("converged:        %zu\n", num_converged);
+    if (num_converged > 0)
+        printf("steps to converge: min %d, max %d\n", min_steps, max_steps);
+    printf("final loss:       min %.9g, mean %.9g, max %.9g\n",
+           min_loss, sum_loss / descent.size(), max_loss);
+    printf("wall time:        %.3f s\n", seconds);
+    printf("throughput:       %.3g ball-steps/s\n",
+           seconds > 0 ? total_steps / seconds : 0.);
+}
+
+
+
+void writeSweepResults(FILE* file, const std::vector<SweepResult>& results){
+    fprintf(file, "surface,learning_rate,decay_rate,discount_factor,"
+                  "squared_discount_factor,beta1,beta2,converged,steps_to_converge,"
+                  "final_loss,wall_time\n");
+    for (const SweepResult& result : results){
+        const Hyperparameters& h = result.configuration.hyperparameters;
+        fprintf(file, "%s,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%zu,%d,%.17g,%.6f\n",
+                Surface::functionName(result.configuration.function_name),
+                h.learning_rate, h.decay_rate, h.discount_factor,
+                h.squared_discount_factor, h.beta1, h.beta2,
+                result.num_converged, result.steps_to_converge,
+                result.final_loss, result.wall_time);
+    }
+}
+
+
+int runSweep(const Options& options){
+    SweepConfiguration base;
+    base.function_name = options.function_name;
+    base.hyperparameters = options.hyperparameters;
+    std::vector<SweepConfiguration> configurations = options.sweep_samples > 0 ?
+                Sweep::random(options.sweep_space, base, options.sweep_samples, options.seed) :
+                Sweep::grid(options.sweep_space, base);
+
+    FILE* output = stdout;
+    if (!options.sweep_path.empty()){
+        output = fopen(options.sweep_path.c_str(), "w");
+        if (output == nullptr){
+            fprintf(stderr, "can't open %s\n", options.sweep_path.c_str());
+            return 1;
+        }
+    }
+
+    ThreadPool pool(options.num_threads);
+    auto start_time = std::chrono::steady_clock::now();
+    std::vector<SweepResult> results = Sweep::run(
+                options.optimizer_name, configurations, options.starting_points,
+                options.max_steps, pool);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+    writeSweepResults(output, results);
+    if (output != stdout) fclose(output);
+
+    double busy_time = 0.;
+    for (const SweepResult& result : results) busy_time += result.wall_time;
+    fprintf(stderr, "%zu configurations of %s on %d threads in %.3f s "
+                    "(%.3f s of work)\n",
+            results.size(), Optimizer::name(options.optimizer_name),
+            pool.numThreads(), elapsed.count(), busy_time);
+    return 0;
+}
+
+}
+
+
+int main(int argc, char** argv){
+    Options options;
+    if (!parseArguments(argc, argv, options)){
+        printUsage();
+        return 1;
+    }
+    if (options.isSweep())
+        return runSweep(options);
+
+    GradientDescent::function_name = options.function_name;
+    BatchGradientDescent descent(options.optimizer_name, options.hyperparameters);
+    descent.setStartingPositions(options.starting_points);
+
+    FILE* trajectory = nullptr;
+    std::vector<int> written_steps(descent.size(), -1);
+    if (!options.trajectory_path.empty()){
+        trajectory = fopen(options.trajectory_path.c_str(), "w");
+        if (trajectory == nullptr){
+            fprintf(stderr, "can't open %s\n", options.trajectory_path.c_str());
+            return 1;
+        }
+        fprintf(trajectory, "ball,step,x,z,loss\n");
+        writeTrajectoryRows(trajectory, descent, written_steps);
+    }
+
+    TrajectoryWriter binary_trajectory;
+    const bool write_binary = !options.binary_trajectory_path.empty();
+    if (write_binary && options.function_name >= Function::custom){
+        // the format names the surface but has no room for an expression or grid
+        fprintf(stderr, "binary trajectories can't record the custom or heightmap surface\n");
+        return 1;
+    }
+    if (write_binary && !binary_trajectory.open(
+                options.binary_trajectory_path,
+                TrajectoryHeader::create(options.function_name, options.optimizer_name,
+                                         options.hyperparameters, descent.size(),
+                                         options.trajectory_interval),
+                options.starting_points)){
+        fprintf(stderr, "can't open %s\n", options.binary_trajectory_path.c_str());
+        return 1;
+    }
+
+    auto record = [&](int step){
+        if (trajectory != nullptr)
+            writeTrajectoryRows(trajectory, descent, written_steps);
+        if (write_binary)
+            binary_trajectory.append(descent.batchState().x.data(),
+                                     descent.batchState().z.data(), step);
+    };
+    auto start_time = std::chrono::steady_clock::now();
+    int steps_taken = 0;
+    for (int step = 1; step <= options.max_steps; step++){
+        if (descent.numConverged() == descent.size()) break;
+        descent.takeGradientSteps();
+        steps_taken = step;
+        if (step % options.trajectory_interval == 0) record(step);
+    }
+    // the trajectories end where the run did, between intervals or not
+    if (steps_taken % options.trajectory_interval != 0) record(steps_taken);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+    if (trajectory != nullptr) fclose(trajectory);
+    if (write_binary && !binary_trajectory.close()){
+        fprintf(stderr, "failed to write %s\n", options.binary_trajectory_path.c_str());
+        return 1;
+    }
+
+    if (!options.summary_path.empty()){
+        FILE* summary = fopen(options.summary_path.c_str(), "w");
+        if (summary == nullptr){
+            fprintf(stderr, "can't open %s\n", options.summary_path.c_str());
+            return 1;
+        }
+        writeSummary(summary, descent, options.starting_points);
+        fclose(summary);
+    }
+
+    printStatistics(options, descent, elapsed.count());
+    return 0;
+}
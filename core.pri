@@ -0,0 +1,50 @@
+# Simulation core: surfaces and descent methods, without any Qt dependency.
+# Shared by the GUI (which picks these files up through its globs) and the
+# command-line runner in cli/.
+
+INCLUDEPATH += $$PWD/headers
+# the sweep runs on a thread pool
+CONFIG += thread
+# the vector kernels round like the scalar ones only if no multiply and add
+# is fused, which clang (and gcc with -mfma) otherwise does
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+HEADERS += \
+    $$PWD/headers/point.h \
+    $$PWD/headers/surface.h \
+    $$PWD/headers/surface_kernels.h \
+    $$PWD/headers/expression.h \
+    $$PWD/headers/heightmap.h \
+    $$PWD/headers/gradient_descent.h \
+    $$PWD/headers/batch_descent.h \
+    $$PWD/headers/batch_kernels.h \
+    $$PWD/headers/thread_pool.h \
+    $$PWD/headers/sweep.h \
+    $$PWD/headers/basin_map.h \
+    $$PWD/headers/spsc_queue.h \
+    $$PWD/headers/simulation_thread.h \
+    $$PWD/headers/timeline.h \
+    $$PWD/headers/mapped_file.h \
+    $$PWD/headers/trajectory_file.h
+
+SOURCES += \
+    $$PWD/src/surface.cpp \
+    $$PWD/src/surface_kernels.cpp \
+    $$PWD/src/surface_kernels_x86.cpp \
+    $$PWD/src/expression.cpp \
+    $$PWD/src/heightmap.cpp \
+    $$PWD/src/gradient_descent.cpp \
+    $$PWD/src/batch_descent.cpp \
+    $$PWD/src/batch_kernels.cpp \
+    $$PWD/src/batch_kernels_x86.cpp \
+    $$PWD/src/thread_pool.cpp \
+    $$PWD/src/sweep.cpp \
+    $$PWD/src/basin_map.cpp \
+    $$PWD/src/simulation_thread.cpp \
+    $$PWD/src/timeline.cpp \
+    $$PWD/src/mapped_file.cpp \
+    $$PWD/src/trajectory_file.cpp
+
+DISTFILES += \
+    $$PWD/src/batch_kernels_simd.inl \
+    $$PWD/src/surface_kernels_simd.inl
@@ -3,11 +3,16 @@ QT       += core datavisualization
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++11
+# the vector kernels round like the scalar ones only if no multiply and add
+# is fused, which clang (and gcc with -mfma) otherwise does
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
 DEFINES += QT_DEPRECATED_WARNINGS
 
 INCLUDEPATH += $$PWD/headers
 HEADERS += $$files($$PWD/headers/*.h, true)
 SOURCES += $$files($$PWD/src/*.cpp, true)
+# vector kernels included once per instruction set by the *_x86.cpp files
+DISTFILES += $$files($$PWD/src/*.inl, true)
 RESOURCES += resources/resources.qrc
 
 # Default rules for deployment.
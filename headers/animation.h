@@ -4,15 +4,17 @@
 #include <memory>
 
 #include <QtCore/QTimer>
+#include <QtGui/QColor>
 #include <QtDataVisualization/QCustom3DItem>
 #include <QtDataVisualization/Q3DSurface>
 
 #include "gradient_descent.h"
 #include "item.h"
+#include "simulation_thread.h"
 
 using namespace  QtDataVisualization;
 
-const auto f = GradientDescent::f;
+const Surface::BatchFunction f = GradientDescent::f;
 const float kBallYOffset = 10.f;
 const float stepX = 4. / 49;
 const float stepZ = 4. / 49;
@@ -24,20 +26,31 @@ const float kSimpleAnimationArrowScale = 0.2;
 class Animation
 {
 public:
-    Animation(Q3DSurface* _graph, QTimer* _timer)
-        : m_graph(_graph),
+    Animation(Q3DSurface* _graph, PathRenderer* _paths, QTimer* _timer)
+        : samples(kSampleQueueCapacity),
+          m_graph(_graph),
+          paths(_paths),
+          items(ItemPool::forGraph(_graph)),
           timer(_timer) {}
     virtual ~Animation(){}
 
     QString name;
     QColor ball_color;
     std::unique_ptr<GradientDescent> descent;
+    // filled by the simulation thread, which steps descent in overview mode
+    SpscQueue<DescentSample> samples;
+    Timeline timeline;
 
     QString triggerDetailedAnimation(int animation_speedup);
-    virtual void triggerSimpleAnimation(int animation_speedup,
+    virtual void triggerSimpleAnimation(
         bool show_gradient, bool show_adjusted_gradient,
         bool show_momentum, bool show_gradient_squared,
         bool show_path);
+    void drawLastSample(bool show_gradient, bool show_adjusted_gradient,
+        bool show_momentum, bool show_gradient_squared, bool show_path);
+    // jump to the given step of the timeline. call drawLastSample to show it.
+    void seek(int step);
+    int step(){return last_sample.step;}
 
     void cleanupAll();
     void cleanupGradient();
@@ -57,30 +70,42 @@ protected:
     bool m_visible = true;
     bool detailed_animation_prepared = false;
     bool show_path = false;
+    // the latest state of descent received from the simulation thread
+    DescentSample last_sample;
+    // the path so far with the step of each point, to redraw it after a
+    // seek. decimated like a Line, so it never holds more than
+    // kLineMaxCrosslines points however long the run.
+    struct PathPoint {
+        int step;
+        Point position;
+    };
+    std::vector<PathPoint> path_history;
+    double path_history_tolerance = 0.;
 
     // don't own these
     Q3DSurface* m_graph;
+    PathRenderer* paths;
+    ItemPool* items;
     QTimer* timer;
 
     // visual elements (applicable to all descents)
     std::unique_ptr<Ball> ball;
-    std::unique_ptr<Ball> temporary_ball = nullptr;
-    std::unique_ptr<Arrow> arrowX = nullptr;
-    std::unique_ptr<Arrow> arrowZ = nullptr;
-    std::unique_ptr<Arrow> adjustedArrowX = nullptr;
-    std::unique_ptr<Arrow> adjustedArrowZ = nullptr;
-    std::unique_ptr<Arrow> total_arrow = nullptr;
+    // the rest go back to the item pool when they are reset
+    ItemPool::Handle<Ball> temporary_ball = nullptr;
+    ItemPool::Handle<Arrow> arrowX = nullptr;
+    ItemPool::Handle<Arrow> arrowZ = nullptr;
+    ItemPool::Handle<Arrow> adjustedArrowX = nullptr;
+    ItemPool::Handle<Arrow> adjustedArrowZ = nullptr;
+    ItemPool::Handle<Arrow> total_arrow = nullptr;
     std::unique_ptr<Line> path = nullptr;
     // visual elements (applicable to some descents)
-    std::unique_ptr<Arrow> momentumArrowX = nullptr;
-    std::unique_ptr<Arrow> momentumArrowZ = nullptr;
-    std::unique_ptr<Square> squareX = nullptr;
-    std::unique_ptr<Square> squareZ = nullptr;
+    ItemPool::Handle<Arrow> momentumArrowX = nullptr;
+    ItemPool::Handle<Arrow> momentumArrowZ = nullptr;
+    ItemPool::Handle<Square> squareX = nullptr;
+    ItemPool::Handle<Square> squareZ = nullptr;
 
     virtual QString animateStep() = 0;
     virtual int interval(){return kInterval;}
-    virtual Point momentum(){return Point();};
-    virtual Point gradSumOfSquared(){return Point();};
 
     void animateGradient();
     void animateAdjustedGradient();
@@ -90,14 +115,15 @@ protected:
     void initializeSquares();
     void prepareDetailedAnimation();
     void cleanupAllButPath();
+    void decimatePathHistory();
 };
 
 
 class GradientDescentAnimation : public Animation
 {
 public:
-    GradientDescentAnimation(Q3DSurface* _graph, QTimer* _timer)
-        : Animation(_graph, _timer)
+    GradientDescentAnimation(Q3DSurface* _graph, PathRenderer* _paths, QTimer* _timer)
+        : Animation(_graph, _paths, _timer)
     {
         name = "Gradient Descent";
         num_states = 4;
@@ -116,8 +142,8 @@ protected:
 class MomentumAnimation : public Animation
 {
 public:
-    MomentumAnimation(Q3DSurface* _graph, QTimer* _timer)
-        : Animation(_graph, _timer)
+    MomentumAnimation(Q3DSurface* _graph, PathRenderer* _paths, QTimer* _timer)
+        : Animation(_graph, _paths, _timer)
     {
         name = "Momentum";
         num_states = 6;
@@ -128,16 +154,12 @@ public:
     };
 
     QString animateStep();
-
-protected:
-    Point momentum(){return Point(-descent->delta().x / descent->learning_rate,
-                                  -descent->delta().z / descent->learning_rate);}
 };
 
 class QHMAnimation : public Animation {
 public:
-    QHMAnimation( Q3DSurface *_graph, QTimer *_timer )
-        : Animation( _graph, _timer )
+    QHMAnimation( Q3DSurface *_graph, PathRenderer *_paths, QTimer *_timer )
+        : Animation( _graph, _paths, _timer )
     {
         name = "QHM";
         num_states = 6;
@@ -148,22 +170,14 @@ public:
     };
 
     QString animateStep();
-
-protected:
-    Point momentum()
-    {
-        return Point(
-                -descent->delta().x / descent->learning_rate,
-                -descent->delta().z / descent->learning_rate );
-    }
 };
 
 
 class AdaGradAnimation : public Animation
 {
 public:
-    AdaGradAnimation(Q3DSurface* _graph, QTimer* _timer)
-        : Animation(_graph, _timer)
+    AdaGradAnimation(Q3DSurface* _graph, PathRenderer* _paths, QTimer* _timer)
+        : Animation(_graph, _paths, _timer)
     {
         name = "Adagrad";
         num_states = 6;
@@ -178,17 +192,14 @@ public:
 protected:
     // scale up the arrow, otherwise you can't see because adagrad moves so slow
     const float arrowScale = 1;
-
-    Point gradSumOfSquared() {
-        return dynamic_cast<AdaGrad*> (descent.get())->gradSumOfSquared();}
 };
 
 
 class RMSPropAnimation : public Animation
 {
 public:
-    RMSPropAnimation(Q3DSurface* _graph, QTimer* _timer)
-        : Animation(_graph, _timer)
+    RMSPropAnimation(Q3DSurface* _graph, PathRenderer* _paths, QTimer* _timer)
+        : Animation(_graph, _paths, _timer)
     {
         name = "RMSprop";
         num_states = 7;
@@ -202,17 +213,14 @@ public:
 
 protected:
     const float arrowScale = 1;
-
-    Point gradSumOfSquared(){
-        return dynamic_cast<RMSProp*> (descent.get())->decayedGradSumOfSquared();}
 };
 
 
 class AdamAnimation : public Animation
 {
 public:
-    AdamAnimation(Q3DSurface* _graph, QTimer* _timer)
-        : Animation(_graph, _timer)
+    AdamAnimation(Q3DSurface* _graph, PathRenderer* _paths, QTimer* _timer)
+        : Animation(_graph, _paths, _timer)
     {
         name = "Adam";
         num_states = 9;
@@ -230,17 +238,12 @@ protected:
     const float arrowScale = 1;
     int interval() {return 5000;}
 
-    Point momentum() {
-        return dynamic_cast<Adam*> (descent.get())->decayedGradSum();}
-    Point gradSumOfSquared(){
-        return dynamic_cast<Adam*> (descent.get())->decayedGradSumOfSquared();}
-
 };
 
 class QHAdamAnimation : public Animation {
 public:
-    QHAdamAnimation( Q3DSurface *_graph, QTimer *_timer )
-        : Animation( _graph, _timer )
+    QHAdamAnimation( Q3DSurface *_graph, PathRenderer *_paths, QTimer *_timer )
+        : Animation( _graph, _paths, _timer )
     {
         name = "QHAdam";
         num_states = 9;
@@ -260,14 +263,5 @@ protected:
     {
         return 5000;
     }
-
-    Point momentum()
-    {
-        return dynamic_cast<QHAdam *>( descent.get() )->decayedGradSum();
-    }
-    Point gradSumOfSquared()
-    {
-        return dynamic_cast<QHAdam *>( descent.get() )->decayedGradSumOfSquared();
-    }
 };
 #endif // ANIMATION_H
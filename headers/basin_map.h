@@ -0,0 +1,74 @@
+#ifndef BASINMAP_H
+#define BASINMAP_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "gradient_descent.h"
+#include "point.h"
+#include "surface.h"
+
+class ThreadPool;
+
+
+// Starts one descent method from every cell of a resolution x resolution grid
+// over a rectangle and records, per cell, which minimum the descent ended in
+// and how many steps it took. Rows are computed in parallel in chunks and can
+// be read while the rest is still running (see takeFinishedRows).
+//
+// row i of the grid is at z = min_z + i * (max_z - min_z) / (resolution - 1),
+// column j at x = min_x + j * (max_x - min_x) / (resolution - 1), the same
+// layout as the surface mesh.
+class BasinMap {
+public:
+    BasinMap(Function::FunctionName function_name,
+             Optimizer::OptimizerName optimizer_name,
+             const Hyperparameters& hyperparameters,
+             int resolution, double min_x, double max_x, double min_z, double max_z);
+
+    const Function::FunctionName function_name;
+    const Optimizer::OptimizerName optimizer_name;
+    const Hyperparameters hyperparameters;
+    int max_steps = 10000;
+    // end points closer than this count as the same minimum
+    double minimum_tolerance = 0.05;
+
+    int resolution() const {return m_resolution;}
+    Point startingPoint(int row, int column) const;
+
+    // runs every cell on the pool and returns when all are done or cancel()
+    // was called. call it from a thread of your own to keep a UI responsive.
+    void compute(ThreadPool& pool);
+    // may be called from any thread
+    void cancel() {cancelled = true;}
+    bool isCancelled() const {return cancelled;}
+    bool isFinished() const {return finished;}
+
+    // rows that finished since the last call. basin() and numSteps() of a
+    // returned row don't change any more.
+    std::vector<int> takeFinishedRows();
+    // index into minima() of the minimum the cell's descent ended in; -1 if
+    // it didn't converge within max_steps
+    int basin(int row, int column) const {return basins[row * m_resolution + column];}
+    int numSteps(int row, int column) const {return steps[row * m_resolution + column];}
+    // where each basin's descents ended, in order of discovery
+    std::vector<Point> minima() const;
+
+private:
+    int m_resolution;
+    double min_x, max_x, min_z, max_z;
+    std::vector<int> basins;
+    std::vector<int> steps;
+
+    std::atomic<bool> cancelled;
+    std::atomic<bool> finished;
+    mutable std::mutex mutex; // guards m_minima and finished_rows
+    std::vector<Point> m_minima;
+    std::vector<int> finished_rows;
+
+    void computeRows(int begin, int end);
+    int findOrAddMinimum(const Point& p);
+};
+
+#endif // BASINMAP_H
@@ -0,0 +1,79 @@
+#ifndef BATCHDESCENT_H
+#define BATCHDESCENT_H
+
+#include <vector>
+
+#include "gradient_descent.h"
+#include "point.h"
+
+
+// gradients are skipped in blocks of this many balls, once all of them have
+// converged. a multiple of the widest surface kernel.
+const size_t kGradientBlockSize = 8;
+
+
+// state of every ball in a batch, stored as structure-of-arrays so that one
+// step of the whole batch walks contiguous memory. index i of every vector
+// belongs to ball i.
+struct BatchState {
+    std::vector<double> x, z;             // current position
+    std::vector<double> grad_x, grad_z;   // gradient at the current position
+    std::vector<double> delta_x, delta_z; // movement of the last gradient step
+    // momentum for qhm; decayed sum of gradients for adam and qhadam
+    std::vector<double> first_moment_x, first_moment_z;
+    // sum of squared gradients for adagrad; decayed sum for rmsprop, adam and qhadam
+    std::vector<double> second_moment_x, second_moment_z;
+    std::vector<double> beta1_pow, beta2_pow; // adam bias correction
+    std::vector<unsigned char> converged;
+    std::vector<int> num_steps;           // gradient steps taken so far
+
+    size_t size() const {return x.size();}
+    void resize(size_t n);
+};
+
+
+// Runs many balls of the same descent method at once. Produces the same
+// trajectories as stepping the same number of GradientDescent objects one by
+// one, but dispatches on the method once per batch instead of once per ball.
+class BatchGradientDescent {
+public:
+    BatchGradientDescent(Optimizer::OptimizerName optimizer_name,
+                         const Hyperparameters& hyperparameters);
+    // copy the method and its latest published settings from a single-ball
+    // descent
+    explicit BatchGradientDescent(GradientDescent* prototype);
+
+    Optimizer::OptimizerName optimizer_name;
+    Hyperparameters hyperparameters;
+    // the surface this batch descends on; starts as GradientDescent::function_name.
+    // set it before setStartingPositions.
+    Function::FunctionName function_name;
+
+    size_t size() const {return state.size();}
+    const BatchState& batchState() const {return state;}
+    Point position(size_t i) const {return Point(state.x[i], state.z[i]);}
+    bool isConverged(size_t i) const {return state.converged[i];}
+    // value of the surface at the position of ball i
+    double loss(size_t i) const;
+    // the value of the surface at every ball, in one batch
+    std::vector<double> losses() const;
+    size_t numConverged() const;
+
+    void setStartingPositions(const std::vector<Point>& points);
+    void resetPositionsAndComputeGradients();
+    // take one gradient step for every ball that has not converged yet
+    void takeGradientSteps();
+
+protected:
+    std::vector<Point> starting_points;
+    BatchState state;
+
+    void updateConvergence();
+    void updateGradientDeltas();
+    void applyDeltasAndComputeGradients();
+
+    // the gradient of balls [begin, end), by one batch call to SurfaceKernels
+    void computeGradients(size_t begin, size_t end);
+};
+
+#endif // BATCHDESCENT_H
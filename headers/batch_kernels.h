@@ -0,0 +1,45 @@
+#ifndef BATCHKERNELS_H
+#define BATCHKERNELS_H
+
+#include <stddef.h>
+
+#include "batch_descent.h"
+
+
+// The per-step math of every descent method, applied to a whole BatchState.
+// On x86 CPUs that support it the update runs 4 (AVX2) or 8 (AVX-512) balls
+// per instruction; elsewhere, and for the last few balls of a batch, a scalar
+// loop does the same computation in the same order.
+namespace BatchKernels{
+enum InstructionSet {scalar, avx2, avx512};
+
+// the widest instruction set supported by this CPU and build
+InstructionSet detectInstructionSet();
+// the instruction set updateGradientDeltas() dispatches to. defaults to
+// detectInstructionSet(); can be lowered, e.g. to compare against scalar.
+InstructionSet instructionSet();
+void setInstructionSet(InstructionSet instruction_set);
+const char* instructionSetName(InstructionSet instruction_set);
+
+// update delta and optimizer state of every ball that has not converged
+void updateGradientDeltas(Optimizer::OptimizerName optimizer_name,
+                          const Hyperparameters& hyperparameters,
+                          BatchState& state);
+
+// the scalar kernel on balls [begin, end). also used for the batch tail.
+void updateGradientDeltasScalar(Optimizer::OptimizerName optimizer_name,
+                                const Hyperparameters& hyperparameters,
+                                BatchState& state, size_t begin, size_t end);
+
+// the vector kernels update the largest prefix of the batch that is a multiple
+// of the vector width and return its length. only call them if the CPU
+// supports the instruction set.
+size_t updateGradientDeltasAvx2(Optimizer::OptimizerName optimizer_name,
+                                const Hyperparameters& hyperparameters,
+                                BatchState& state);
+size_t updateGradientDeltasAvx512(Optimizer::OptimizerName optimizer_name,
+                                  const Hyperparameters& hyperparameters,
+                                  BatchState& state);
+}
+
+#endif // BATCHKERNELS_H
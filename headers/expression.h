@@ -0,0 +1,78 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// the expression Function::custom starts with
+const char* const kDefaultExpression = "x^2 + z^2 + sin(3*x) * sin(3*z)";
+
+
+// A program for a register machine: every instruction reads one or two
+// registers and writes a third, each register holding a block of points.
+// Register 0 holds x and register 1 holds z; the constant registers are set
+// once before the first instruction and never written.
+struct ExpressionProgram {
+    enum OpCode {add, subtract, multiply, divide, negate, sqrt, exp, sin, cos};
+    struct Instruction {
+        OpCode op;
+        int destination;
+        int a;
+        int b; // == a for the unary ops
+    };
+    struct Constant {
+        int reg;
+        double value;
+    };
+
+    std::vector<Instruction> instructions;
+    std::vector<Constant> constants;
+    int num_registers = 2;
+    // the registers that hold the results when the program ends
+    std::vector<int> outputs;
+    // the registers of a single point before the first instruction: the
+    // constants in place, 0 elsewhere
+    std::vector<double> point_registers;
+};
+
+
+// A surface typed in by the user, e.g. "x^2 + 10*sin(z)".
+//
+// The text is parsed into a graph in which equal subexpressions are one node,
+// constant parts are folded, and the partial derivatives are derived
+// symbolically in the same graph. Two programs are compiled from it: f alone,
+// and f with its gradient, which shares the common work of the three. See
+// SurfaceKernels for running them.
+//
+// Syntax: numbers, x, z, pi, e, + - * / ^, parentheses and the functions
+// sqrt, exp, sin and cos. Exponents must be whole numbers (after folding).
+class Expression {
+public:
+    // returns nullptr, with a message in error, if text can't be compiled
+    static std::shared_ptr<const Expression> compile(const std::string& text,
+                                                     std::string& error);
+
+    const std::string& text() const {return m_text;}
+    // outputs: f
+    const ExpressionProgram& valueProgram() const {return value_program;}
+    // outputs: f, df/dx, df/dz
+    const ExpressionProgram& gradientProgram() const {return gradient_program;}
+
+private:
+    Expression() {}
+    std::string m_text;
+    ExpressionProgram value_program;
+    ExpressionProgram gradient_program;
+};
+
+
+namespace Surface{
+// the expression Function::custom evaluates, kDefaultExpression at first.
+// only replace it while nothing evaluates the custom surface; the returned
+// reference is good until then.
+const std::shared_ptr<const Expression>& customExpression();
+void setCustomExpression(std::shared_ptr<const Expression> expression);
+}
+
+#endif // EXPRESSION_H
@@ -1,27 +1,67 @@
 #ifndef GRADIENTDESCENT_H
 #define GRADIENTDESCENT_H
 
+#include <atomic>
 #include <memory>
-
-#include <QtDataVisualization/QCustom3DItem>
-#include <QColor>
+#include <string>
 
 #include "point.h"
+#include "surface.h"
+
 
+namespace Optimizer{
+enum OptimizerName {vanilla, momentum, qhm, ada_grad, rms_prop, adam, qhadam};
+const int kNumOptimizers = 7;
 
-namespace Function{
-enum FunctionName {local_minimum, global_minimum, saddle_point, ecliptic_bowl,
-                  hills, plateau};
+// the identifier of a descent method as text, e.g. "rms_prop"
+const char* name(OptimizerName optimizer_name);
+// returns false if name is not a descent method
+bool fromName(const std::string& name, OptimizerName& optimizer_name);
 }
 
+const double kDivisionEpsilon = 1e-12;
+const double kConvergenceEpsilon = 1e-2;
+
+
+// union of the tunable parameters of all descent methods. each method only
+// reads the fields it uses.
+struct Hyperparameters {
+    double learning_rate = 0.001;
+    double decay_rate = 0.9;               // momentum, qhm, rmsprop
+    double discount_factor = 0.7;          // qhm, qhadam
+    double squared_discount_factor = 1.0;  // qhadam
+    double beta1 = 0.9;                    // adam, qhadam
+    double beta2 = 0.999;                  // adam, qhadam
+    bool use_bias_correction = true;       // adam, qhadam
+};
+
+
+// everything a descent needs to carry on from where it was. the moments are
+// the method's internal sums, as in BatchState; unused ones stay zero.
+struct DescentState {
+    Hyperparameters hyperparameters; // the set in use
+    Point position;
+    Point delta;
+    Point gradient;
+    Point first_moment;
+    Point second_moment;
+    double beta1_pow = 0.;
+    double beta2_pow = 0.;
+    bool converged = false;
+};
+
 
 class GradientDescent {
 public:
     GradientDescent();
-    virtual ~GradientDescent() {}
+    virtual ~GradientDescent();
+    GradientDescent(const GradientDescent&) = delete;
+    GradientDescent& operator=(const GradientDescent&) = delete;
+    static std::unique_ptr<GradientDescent> create(Optimizer::OptimizerName optimizer_name);
 
     double learning_rate = 0.001;
     static Function::FunctionName function_name;
+    static Gradient::GradientMethod gradient_method;
 
     // simple getters and setters
     Point position() {return p;}
@@ -30,12 +70,48 @@ public:
     double gradX() {return grad.x;};
     double gradZ() {return grad.z;};
     Point delta() {return m_delta;}
-
+    // the method's state as the app draws it: momentum as arrows and the
+    // (decayed) sum of squared gradients as squares. zero if not used.
+    virtual Point momentum() {return Point();}
+    virtual Point gradSumOfSquared() {return Point();}
+
+    virtual Optimizer::OptimizerName optimizerName() = 0;
+    virtual Hyperparameters hyperparameters();
+    // Live tuning. The thread that steps the descent is the only one that
+    // writes its hyperparameter fields; any other thread (the UI) publishes a
+    // new immutable set instead, which the descent picks up at the start of
+    // its next step or reset. Publishing never waits for the stepping thread.
+    // Call both from the same thread.
+    void publishHyperparameters(const Hyperparameters& params);
+    // the set last published, or the current one if none was: what the next
+    // edit starts from
+    Hyperparameters publishedHyperparameters();
+    // how many published sets the descent has taken into use
+    unsigned hyperparametersVersion() {return applied_version;}
+    // for replaying recorded steps (see Timeline): take params into use now,
+    // and step without taking up a newly published set, which stays pending.
+    // only call while nothing else steps the descent.
+    void restoreHyperparameters(const Hyperparameters& params) {setHyperparameters(params);}
+    Point replayGradientStep();
 
     // core methods
+    // the current surface at n points at once (see SurfaceKernels):
+    // out[i] = f(xs[i], zs[i]). prefer it to a loop over single points.
+    static void f(const double* xs, const double* zs, double* out, size_t n);
+    static void gradient(const double* xs, const double* zs,
+                         double* grad_x, double* grad_z, size_t n);
+    // single-point versions of the above
     static double f(double x, double z);
+    // f and its analytic gradient from a single evaluation of the surface
+    static double valueAndGradient(double x, double z, Point& grad);
+    static Point gradient(double x, double z);
     Point takeGradientStep();
     void resetPositionAndComputeGradient();
+    // snapshot of the current state, hyperparameters included, e.g. for
+    // Timeline. restoring it makes the following steps identical to those
+    // after the snapshot was taken, unless a new set is published.
+    DescentState saveState();
+    void restoreState(const DescentState& state);
 
 protected:
     Point p; // current position
@@ -48,12 +124,34 @@ protected:
     void computeGradient();
     virtual void updateGradientDelta() = 0;
     virtual void resetState(){}
+    // copy the method's internal sums to / from a snapshot
+    virtual void saveMoments(DescentState& /* state */){}
+    virtual void restoreMoments(const DescentState& /* state */){}
+    // copy the fields the method uses from params
+    virtual void setHyperparameters(const Hyperparameters& params);
+
+private:
+    struct Snapshot {
+        Hyperparameters params;
+        unsigned version;
+    };
+    // published but not taken into use yet. whoever swaps a snapshot out
+    // owns it: the descent when it applies it, the publisher when it replaces
+    // one the descent never got to.
+    std::atomic<Snapshot*> pending_snapshot{nullptr};
+    unsigned applied_version = 0;
+    // publisher side
+    Hyperparameters published;
+    unsigned published_version = 0;
+
+    void applyPublishedHyperparameters();
 };
 
 
 class VanillaGradientDescent : public GradientDescent {
 public:
     VanillaGradientDescent() {}
+    Optimizer::OptimizerName optimizerName() {return Optimizer::vanilla;}
 
 protected:
      void updateGradientDelta();
@@ -63,16 +161,26 @@ protected:
 class Momentum : public GradientDescent {
 public:
     Momentum() {}
+    Optimizer::OptimizerName optimizerName() {return Optimizer::momentum;}
+    Hyperparameters hyperparameters();
+    Point momentum() {return Point(-m_delta.x / learning_rate, -m_delta.z / learning_rate);}
 
     double decay_rate = 0.9;
 
 protected:
     void updateGradientDelta();
+    void setHyperparameters(const Hyperparameters& params);
 };
 
 class QHM : public GradientDescent {
 public:
-    QHM(): momentum( 0., 0.) { }
+    QHM(): m_momentum( 0., 0.) { }
+    Optimizer::OptimizerName optimizerName() override { return Optimizer::qhm; }
+    Hyperparameters hyperparameters() override;
+    Point momentum() override
+    {
+        return Point( -m_delta.x / learning_rate, -m_delta.z / learning_rate );
+    }
 
     double decay_rate = 0.990;     // beta
     double discount_factor = 0.7;  // v
@@ -80,18 +188,24 @@ public:
 protected:
     void updateGradientDelta() override;
     void resetState() override;
+    void saveMoments( DescentState &state ) override;
+    void restoreMoments( const DescentState &state ) override;
+    void setHyperparameters( const Hyperparameters &params ) override;
 private:
-    Point momentum;
+    Point m_momentum;
 };
 
 class AdaGrad : public GradientDescent {
 public:
     AdaGrad() : grad_sum_of_squared(0., 0.){}
+    Optimizer::OptimizerName optimizerName() {return Optimizer::ada_grad;}
     Point gradSumOfSquared(){return grad_sum_of_squared;}
 
 protected:
     void updateGradientDelta();
     void resetState();
+    void saveMoments(DescentState& state);
+    void restoreMoments(const DescentState& state);
 
 private:
     Point grad_sum_of_squared;
@@ -100,13 +214,19 @@ private:
 class RMSProp : public GradientDescent {
 public:
     RMSProp() : decayed_grad_sum_of_squared(0., 0.){}
+    Optimizer::OptimizerName optimizerName() {return Optimizer::rms_prop;}
+    Hyperparameters hyperparameters();
 
     double decay_rate = 0.99;
     Point decayedGradSumOfSquared(){return decayed_grad_sum_of_squared;}
+    Point gradSumOfSquared(){return decayed_grad_sum_of_squared;}
 
 protected:
     void updateGradientDelta();
     void resetState();
+    void saveMoments(DescentState& state);
+    void restoreMoments(const DescentState& state);
+    void setHyperparameters(const Hyperparameters& params);
 
 private:
     Point decayed_grad_sum_of_squared;
@@ -120,6 +240,8 @@ public:
         , beta1_pow( beta1 )
         , beta2_pow( beta2 )
     { }
+    Optimizer::OptimizerName optimizerName() override { return Optimizer::adam; }
+    Hyperparameters hyperparameters() override;
 
     double beta1 = 0.9;
     double beta2 = 0.999;
@@ -127,11 +249,16 @@ public:
 
     Point decayedGradSum(){return decayed_grad_sum;}
     Point decayedGradSumOfSquared(){return decayed_grad_sum_of_squared;}
+    Point momentum() override {return decayed_grad_sum;}
+    Point gradSumOfSquared() override {return decayed_grad_sum_of_squared;}
 
 protected:
     void baseCompute( Point &scaled_decayed_grad_sum, Point &scaled_decayed_grad_sum_sq );
     void updateGradientDelta() override;
     void resetState() override;
+    void saveMoments( DescentState &state ) override;
+    void restoreMoments( const DescentState &state ) override;
+    void setHyperparameters( const Hyperparameters &params ) override;
 
 private:
     Point decayed_grad_sum;
@@ -143,12 +270,15 @@ private:
 class QHAdam : public Adam {
 public:
     QHAdam() {}
+    Optimizer::OptimizerName optimizerName() override { return Optimizer::qhadam; }
+    Hyperparameters hyperparameters() override;
 
     double discount_factor = 0.7;         // v1
     double squared_discount_factor = 1.0; // v2
 
 protected:
     void updateGradientDelta() override;
+    void setHyperparameters( const Hyperparameters &params ) override;
 };
 
 #endif // GRADIENTDESCENT_H
@@ -0,0 +1,80 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// the grid of a heightmap spans the plotted area, in x and in z
+const double kHeightmapMin = -2.;
+const double kHeightmapMax = 2.;
+// the vector kernels index the grid with 32-bit integers
+const size_t kMaxHeightmapSamples = 0x7fffffff;
+
+
+// A surface given by heights on a grid, e.g. a loss landscape computed
+// elsewhere, rather than by a formula.
+//
+// Row i of the grid lies at the i-th z from kHeightmapMin, column j at the
+// j-th x. Between the samples the surface is the Catmull-Rom bicubic through
+// the 4 x 4 samples around the point, so its gradient is continuous. Beyond
+// the grid it continues flat: the edge height, with no slope across the edge.
+// SurfaceKernels samples it. Grids read with openRaw() stay in their file,
+// mapped, so opening one takes no time whatever its size.
+class Heightmap {
+public:
+    // raw float32 values in native byte order, row after row. width 0: the
+    // grid is square. returns nullptr, with a message in error, if the file
+    // can't be read or doesn't hold a grid of that width.
+    static std::shared_ptr<const Heightmap> openRaw(const std::string& path, size_t width,
+                                                    std::string& error);
+    // a grid already in memory, e.g. from an image. values.size() must be
+    // width * height, both at least 2.
+    static std::shared_ptr<const Heightmap> fromValues(std::vector<float> values,
+                                                       size_t width, size_t height,
+                                                       const std::string& name);
+
+    Heightmap(const Heightmap&) = delete;
+    Heightmap& operator=(const Heightmap&) = delete;
+
+    // row after row, width() values each
+    const float* values() const {return m_values;}
+    size_t width() const {return m_width;}
+    size_t height() const {return m_height;}
+    // grid cells per unit of x and of z
+    double cellsPerX() const {return cells_per_x;}
+    double cellsPerZ() const {return cells_per_z;}
+    // where it came from, e.g. the file name
+    const std::string& name() const {return m_name;}
+    // unique to this heightmap for the life of the program
+    uint64_t id() const {return m_id;}
+
+private:
+    explicit Heightmap(const std::string& name);
+    void setGrid(const float* values, size_t width, size_t height);
+
+    std::vector<float> owned_values;
+    MappedFile file;
+    const float* m_values = nullptr;
+    size_t m_width = 0;
+    size_t m_height = 0;
+    double cells_per_x = 0.;
+    double cells_per_z = 0.;
+    std::string m_name;
+    uint64_t m_id;
+};
+
+
+namespace Surface{
+// the heightmap Function::heightmap evaluates, flat until one is set. only
+// replace it while nothing evaluates that surface; the returned reference is
+// good until then.
+const std::shared_ptr<const Heightmap>& heightmap();
+void setHeightmap(std::shared_ptr<const Heightmap> heightmap);
+}
+
+#endif // HEIGHTMAP_H
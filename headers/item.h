@@ -1,10 +1,16 @@
 #ifndef ITEM_H
 #define ITEM_H
 
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <QtCore/QObject>
 #include <QtDataVisualization/QCustom3DItem>
 #include <QtDataVisualization/Q3DSurface>
 
 #include "point.h"
+#include "surface.h"
 
 using namespace QtDataVisualization;
 
@@ -19,6 +25,128 @@ const float kBallRadiusPerGraph = 24.63;
 const float kLineHalfWidth = 1. / 200.;
 const float kLineLayerHeight = 0.003;
 const float kLineStepSize = 1. / 50.;
+// a path keeps at most this many crosslines. when it gets there, everything
+// but the newest kLineFullDetail crosslines is simplified.
+const size_t kLineMaxCrosslines = 2000;
+const size_t kLineFullDetail = 500;
+// proxy rows the path renderer keeps for a line: its crosslines between two
+// collapsed rows
+const int kPathLineRows = int(kLineMaxCrosslines) + 2;
+// texture lines per layer
+const int kPathTextureBandHeight = 32;
+// blank rows before and after a line's rows. the texture blends the colors
+// of two layers over half a texture line, region rows / (2 * band height)
+// rows; the margins are twice that.
+const int kPathMarginRows = kPathLineRows / kPathTextureBandHeight;
+const int kPathRegionRows = kPathLineRows + 2 * kPathMarginRows;
+
+
+// distance of p from the segment a-b
+double distanceToSegment(Point p, Point a, Point b);
+
+// Shrinks a path that went over max_points to 3/4 of that: the newest
+// kLineFullDetail points stay as they are and the ones before are simplified
+// with Douglas-Peucker, doubling tolerance (in plot units) until the path
+// fits. Older stretches go through more passes at growing tolerances, so
+// detail falls off with distance from the ball. position(point) is where a
+// point of the path lies.
+template <typename T, typename Position>
+void decimatePath(std::vector<T>& points, size_t max_points, double& tolerance,
+                  Position position){
+    const size_t target = max_points * 3 / 4;
+    while (points.size() > target){
+        // points [0, last_old] are the old part; both ends are kept
+        size_t last_old = points.size() - kLineFullDetail;
+        std::vector<bool> keep(last_old + 1, false);
+        keep[0] = keep[last_old] = true;
+        std::vector<std::pair<size_t, size_t>> stack = {{0, last_old}};
+        while (!stack.empty()){
+            size_t begin = stack.back().first, end = stack.back().second;
+            stack.pop_back();
+            double max_distance = 0.;
+            size_t farthest = begin;
+            for (size_t i = begin + 1; i < end; i++){
+                double d = distanceToSegment(position(points[i]), position(points[begin]),
+                                             position(points[end]));
+                if (d > max_distance){
+                    max_distance = d;
+                    farthest = i;
+                }
+            }
+            if (max_distance > tolerance){
+                keep[farthest] = true;
+                stack.push_back({begin, farthest});
+                stack.push_back({farthest, end});
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < points.size(); i++){
+            if (i > last_old || keep[i]) points[kept++] = points[i];
+        }
+        // erase, not resize: T needn't be default-constructible
+        points.erase(points.begin() + kept, points.end());
+        if (points.size() > target) tolerance *= 2;
+    }
+}
+
+
+// The axis ranges of one graph, kept up to date from the axes' signals, so
+// items sized and placed every frame read a cached value instead of asking
+// the axes.
+class PlotTransform : public QObject{
+    Q_OBJECT
+public:
+    // the graph's transform, created on first use and deleted with the graph
+    static PlotTransform* forGraph(Q3DSurface* graph);
+
+    float minX() const {return min_x;}
+    float maxX() const {return max_x;}
+    float minZ() const {return min_z;}
+    float maxZ() const {return max_z;}
+    float xRange() const {return max_x - min_x;}
+    float yRange() const {return max_y - min_y;}
+    float zRange() const {return max_z - min_z;}
+    // plot units spanned along x and z (y is 0); arrows and squares are
+    // sized relative to it
+    QVector3D scalingVector() const {return scaling_vector;}
+
+private:
+    explicit PlotTransform(Q3DSurface* graph);
+    Q3DSurface* m_graph;
+    std::vector<QMetaObject::Connection> axis_connections;
+    float min_x = 0, max_x = 0, min_y = 0, max_y = 0, min_z = 0, max_z = 0;
+    QVector3D scaling_vector;
+
+    // follow the range signals of the graph's current axes
+    void connectAxes();
+    void update();
+};
+
+
+class Item;
+
+// Collects the transforms the items of one graph are given during a frame and
+// applies them together once control returns to the event loop, so an item
+// moved, rotated and scaled several times in a tick notifies the graph once,
+// and values that end up unchanged don't notify it at all.
+class SceneUpdater : public QObject{
+    Q_OBJECT
+public:
+    // the graph's updater, created on first use and deleted with the graph
+    static SceneUpdater* forGraph(Q3DSurface* graph);
+    // apply every staged transform now
+    void flush();
+
+private:
+    friend class Item;
+    explicit SceneUpdater(Q3DSurface* graph);
+    std::vector<Item*> dirty_items;
+    bool flush_scheduled = false;
+
+    void markDirty(Item* item);
+    void forget(Item* item);
+};
 
 
 class Item : public QCustom3DItem{
@@ -26,15 +154,44 @@ public:
     Item(Q3DSurface* graph) : m_graph(graph){
         m_graph->addCustomItem(this);
     }
-    ~Item(){m_graph->releaseCustomItem(this);}
+    ~Item();
+    QColor color() const {return m_color;}
+
+    // these hide QCustom3DItem's: the transform is staged and handed to the
+    // graph by its SceneUpdater at the end of the frame. the getters return
+    // the staged values.
+    void setPosition(const QVector3D& position);
+    void setScaling(const QVector3D& scaling);
+    void setRotation(const QQuaternion& rotation);
+    QVector3D position() const;
+    QVector3D scaling() const;
+    QQuaternion rotation() const;
+    // apply the staged transform
+    void commit();
 
 protected:
     Item(){}
     Q3DSurface* m_graph = nullptr;
+    QColor m_color;
 
     void setColor(QColor color);
     void addToGraph(Q3DSurface* graph);
     QVector3D plotScalingVector();
+
+    PlotTransform* plotTransform();
+
+private:
+    SceneUpdater* updater = nullptr;
+    PlotTransform* transform = nullptr;
+    bool dirty = false;
+    bool position_staged = false;
+    bool scaling_staged = false;
+    bool rotation_staged = false;
+    QVector3D staged_position;
+    QVector3D staged_scaling;
+    QQuaternion staged_rotation;
+
+    void stage();
 };
 
 
@@ -42,11 +199,12 @@ class Ball : public Item
 {
 public:
     // _f: function that defines the 3d surface the ball rolls on
-    Ball(Q3DSurface* graph, QColor color, double (*_f) (double, double));
+    Ball(Q3DSurface* graph, QColor color, Surface::BatchFunction _f);
     void setPositionOnSurface(Point p);
 
 protected:
-    double (*f) (double, double);
+    friend class ItemPool;
+    Surface::BatchFunction f;
 };
 
 
@@ -81,6 +239,9 @@ public:
     // (presumably to align with the gradient)
     void setArea(const float &area, const bool &is_positive);
     float area(){return m_area;}
+    bool isXDirection(){return m_is_x_direction;}
+    // back to the orientation and size of a new square
+    void reset();
 
 private:
     float m_area;
@@ -91,24 +252,119 @@ private:
 };
 
 
-class Line : public QSurface3DSeries{
+// Hands out arrows, squares and balls for one graph, and takes them back
+// hidden instead of destroying them. A recycled item keeps its mesh and
+// texture, so showing it again costs neither parsing a mesh file nor an
+// allocation. Items are kept by color (squares by direction), the way they
+// are asked for. The graph owns every item, as with Item.
+class ItemPool : public QObject{
+    Q_OBJECT
+public:
+    template <typename T> struct Recycler{
+        Recycler(ItemPool* pool = nullptr) : pool(pool){}
+        void operator()(T* item) const {pool->recycle(item);}
+        ItemPool* pool;
+    };
+    // an item that goes back to the pool when the handle is reset
+    template <typename T> using Handle = std::unique_ptr<T, Recycler<T>>;
+
+    // the graph's pool, created on first use and deleted with the graph
+    static ItemPool* forGraph(Q3DSurface* graph);
+
+    Handle<Arrow> arrow(QVector3D vector, QColor color);
+    // black, pointing up, of magnitude 0
+    Handle<Arrow> arrow();
+    Handle<Square> square(QString direction);
+    Handle<Ball> ball(QColor color, Surface::BatchFunction f);
+
+private:
+    explicit ItemPool(Q3DSurface* graph);
+    Q3DSurface* m_graph;
+    std::map<QRgb, std::vector<Arrow*>> free_arrows;
+    std::map<QRgb, std::vector<Ball*>> free_balls;
+    std::vector<Square*> free_x_squares;
+    std::vector<Square*> free_z_squares;
+
+    void recycle(Arrow* arrow);
+    void recycle(Square* square);
+    void recycle(Ball* ball);
+};
+
+
+class Line;
+
+// Draws every Line as one surface series, so the renderer has one series to
+// draw however many paths there are. Each layer owns a fixed region of
+// kPathRegionRows rows in the shared proxy:
+//
+//   [blank margin] [left, left] [left, right] ... [left, right] [left, left]
+//   [blank rows up to the end of the region]
+//
+// a blank row has both vertices on one point, and a line's rows start and
+// end with a collapsed row (both vertices on its left edge), so every quad
+// outside a line is degenerate and nothing is drawn between paths. Regions
+// never move: a line only sets rows of its own region, and the row count
+// only changes when a new layer adds its region. The colors come from a
+// texture with a band of kPathTextureBandHeight lines per layer, repainted
+// when a line takes a layer.
+class PathRenderer : public QSurface3DSeries{
+public:
+   PathRenderer(Q3DSurface* graph);
+   Q3DSurface* graph() const {return m_graph;}
+
+private:
+   friend class Line;
+   Q3DSurface* m_graph;
+   QSurfaceDataProxy* proxy;
+   // indexed by layer; nullptr for a free layer
+   std::vector<Line*> lines;
+   bool texture_update_pending = false;
+
+   // returns the line's layer. a new layer adds its region, blank.
+   int addLine(Line* line);
+   void removeLine(Line* line);
+   // first proxy row of the line's rows, after its region's margin
+   int lineStart(const Line* line) const;
+   // a layer changed color; repaint the texture once control returns to the
+   // event loop
+   void scheduleTextureUpdate();
+   void updateTexture();
+};
+
+
+class Line{
 public:
-   Line(Q3DSurface* graph, QColor color, double (*_f) (double, double));
+   Line(PathRenderer* renderer, QColor color, Surface::BatchFunction _f);
+   ~Line();
+   Line(const Line&) = delete;
+   Line& operator=(const Line&) = delete;
    void addPoint(Point p);
    void render();
    void erase();
    void setVisible(bool visible);
-   // hack: render the lines with slightly different y offsets
-   // so the colors don't mix
-   static int layer;
 
 private:
+   friend class PathRenderer;
+   PathRenderer* renderer;
    Q3DSurface* m_graph = nullptr;
-   QSurfaceDataProxy* line_proxy = nullptr;
-   double (*f) (double, double);
+   PlotTransform* transform;
+   QColor m_color;
+   Surface::BatchFunction f;
    bool m_visible = true;
-   int this_layer = 0;
+   // lines render with slightly different y offsets so the colors don't mix
+   int layer = 0;
+   // crosslines whose rows are in the renderer's proxy
+   int rendered = 0;
+   // rows from lineStart() on that aren't blank
+   int used_rows = 0;
    bool need_to_replace_last_row = false;
+   bool need_full_rebuild = false;
+   // both vertices of a blank row: on the surface at the center of the plot,
+   // so blank rows don't stretch the axes
+   QVector3D blank_point;
+   // current Douglas-Peucker tolerance for the old part of the path (in plot
+   // units); grows as the path gets longer
+   double decimation_tolerance = 0.;
    float x_range;
    float y_range;
    float z_range;
@@ -119,15 +375,31 @@ private:
        Point center;
        Point left;
        Point right;
+       // surface height at left and right, evaluated once when the crossline
+       // is added so rebuilding the ribbon doesn't need the surface again
+       float left_y = 0.f;
+       float right_y = 0.f;
        CrossLine(Point p) :center(p), left(p), right(p){}
    };
    std::vector<CrossLine> crosslines;
 
-   // make data array for all point in points
-   QSurfaceDataArray* getDataArray();
+   // left and right edge (and their heights) of crossline idx
+   void computeEdges(size_t idx);
+   // simplify the older part of the path to get back under budget
+   void decimate();
+   // the line's rows: collapsed first row, crosslines, collapsed last row
+   QSurfaceDataArray getSegmentRows();
+   // rows for crosslines [begin, end)
+   QSurfaceDataArray getDataRows(int begin, int end);
    QSurfaceDataRow* getDataRow(int idx);
-   // if no index is specified, return the last row by default
-   QSurfaceDataRow* getDataRow();
+   // a row with both vertices on the left edge of crossline idx
+   QSurfaceDataRow* getCollapsedRow(int idx);
+   QSurfaceDataArray getBlankRows(int count);
+   void updateBlankPoint();
+   // rewrites all of the line's rows
+   void rebuildRows();
+   // blanks the line's rows
+   void removeRows();
 };
 
 #endif // ITEM_H
@@ -0,0 +1,38 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <string>
+
+
+// A read-only memory mapping of a whole file. The operating system pages the
+// contents in as they are touched, so files much bigger than memory can be
+// read front to back, or sampled here and there.
+class MappedFile {
+public:
+    // how the contents will be read, so the OS reads ahead (or doesn't)
+    enum Access {sequential, random};
+
+    MappedFile() {}
+    ~MappedFile() {close();}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // returns false if the file can't be opened or mapped
+    bool open(const std::string& path, Access access = sequential);
+    void close();
+
+    bool isOpen() const {return m_data != nullptr;}
+    const unsigned char* data() const {return m_data;}
+    size_t size() const {return m_size;}
+
+private:
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,70 @@
+#ifndef PARTICLESWARM_H
+#define PARTICLESWARM_H
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <QtGui/QColor>
+#include <QtDataVisualization/Q3DSurface>
+#include <QtDataVisualization/QSurface3DSeries>
+
+#include "batch_descent.h"
+#include "item.h"
+#include "thread_pool.h"
+
+using namespace QtDataVisualization;
+
+const int kSwarmSize = 2048;           // particles per descent method
+const size_t kSwarmBatchSize = 256;    // particles stepped by one task
+const float kParticleHalfWidth = 1. / 150.;
+const float kParticleYOffset = 0.005;
+
+
+// Many balls per descent method, started all over the plot and drawn as small
+// flat diamonds. A Ball is a custom item with its own mesh, which is too
+// expensive by the thousand, and a Q3DSurface graph can't host a scatter
+// series; so each method's particles are the rows of one surface series,
+// three per particle:
+//
+//   [top, top] [left, right] [bottom, bottom]
+//
+// The collapsed rows make the quads between two particles degenerate. The
+// rows are allocated at reset and rewritten in place every frame.
+class ParticleSwarm {
+public:
+    // steps the particles on pool
+    ParticleSwarm(Q3DSurface* graph, ThreadPool* pool, int num_particles = kSwarmSize);
+    ~ParticleSwarm();
+    ParticleSwarm(const ParticleSwarm&) = delete;
+    ParticleSwarm& operator=(const ParticleSwarm&) = delete;
+
+    // one cloud per method; the prototype's current settings are copied at
+    // every reset
+    void addDescent(GradientDescent* prototype, QColor color);
+    // new random starting points, the same ones for every method
+    void reset();
+    // take num_steps gradient steps with every particle
+    void step(int num_steps);
+    // show the current positions
+    void render();
+    void setVisible(bool visible);
+
+private:
+    struct Cloud {
+        GradientDescent* prototype;
+        std::unique_ptr<QSurface3DSeries> series;
+        // owned by the series' proxy; kept to rewrite the rows in place
+        QSurfaceDataArray* rows = nullptr;
+        std::vector<std::unique_ptr<BatchGradientDescent>> batches;
+    };
+
+    Q3DSurface* m_graph;
+    PlotTransform* transform;
+    int num_particles;
+    std::vector<Cloud> clouds;
+    std::mt19937 random_engine;
+    ThreadPool* pool;
+};
+
+#endif // PARTICLESWARM_H
@@ -1,17 +1,35 @@
 #ifndef PLOT_H
 #define PLOT_H
 
+#include <stdint.h>
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <QtDataVisualization/QSurfaceDataProxy>
-#include <QtDataVisualization/QHeightMapSurfaceDataProxy>
 #include <QtDataVisualization/QSurface3DSeries>
 #include <QtDataVisualization/Q3DSurface>
 #include <QtCore/QTimer>
+#include <QtGui/QImage>
 
 #include "gradient_descent.h"
+#include "expression.h"
+#include "heightmap.h"
 #include "animation.h"
+#include "basin_map.h"
+#include "particle_swarm.h"
+#include "simulation_thread.h"
+#include "thread_pool.h"
+
+
+const int kDefaultSurfaceResolution = 51;
+// heights kept in the mesh cache, 16 MB: four meshes at the finest resolution,
+// or many more at the coarser ones
+const size_t kMeshCacheBudget = 4 * 1024 * 1024;
 
 
 class PlotArea : public QObject
@@ -20,6 +38,9 @@ class PlotArea : public QObject
 public:
     explicit PlotArea(Q3DSurface *surface);
     ~PlotArea();
+    // draws the paths of all animations and overlays. declared before the
+    // animations so it outlives their Lines.
+    std::unique_ptr<PathRenderer> paths;
     std::unique_ptr<Animation> gradient_descent;
     std::unique_ptr<Animation> momentum;
     std::unique_ptr<Animation> qhm;
@@ -29,8 +50,24 @@ public:
     std::unique_ptr<Animation> qhadam;
     std::vector<Animation *> all_animations;
 
+    // draw the trajectories of a file written by the command line runner (see
+    // trajectory_file.h) on top of the surface, switching to its surface.
+    // returns false if the file can't be read.
+    bool loadTrajectory(QString path);
+    // switch to the heightmap in an image (gray levels) or a raw float32 grid
+    // file (see Heightmap::openRaw). returns false, with a message in error,
+    // if the file is neither.
+    bool loadHeightmap(QString path, QString& error);
+
 signals:
     void updateMessage(QString message);
+    void updateBasinMapMessage(QString message);
+    // why the expression given to setCustomSurface failed, or "" if it didn't
+    void updateCustomSurfaceMessage(QString message);
+    // step: where the animation is now; length: the last step recorded
+    void timelineChanged(int step, int length);
+    // the surface changed other than through changeSurface
+    void surfaceChanged(Function::FunctionName function_name);
 
 public Q_SLOTS:
     void pauseAnimation();
@@ -40,6 +77,7 @@ public Q_SLOTS:
     void setAnimationMode(const int& view_type);
     void setDetailedAnimation(QString descent_name);
     void setAnimationSpeed(int index);
+    void setSurfaceResolution(int index);
     void restartFromClickedPosition(QPoint q_pos);
     void moveCamera(int x_direction, int z_direction);
     void cameraZoomIn();
@@ -50,7 +88,13 @@ public Q_SLOTS:
     void setShowMomentum(bool show);
     void setShowGradientSquared(bool show);
     void setShowPath(bool show);
+    void setShowSwarm(bool show);
     void changeSurface(QString name);
+    // compile text (see Expression) and switch to it as Function::custom, or
+    // report why it doesn't compile
+    void setCustomSurface(QString text);
+    void showBasinMap(QString descent_name);
+    void seekTimeline(int step);
 
 
 private:
@@ -69,10 +113,73 @@ private:
     bool show_momentum = false;
     bool show_gradient_squared = false;
     bool show_path = false;
+    // points per side of the surface mesh
+    int surface_resolution = kDefaultSurfaceResolution;
+    // heights of the meshes built recently, by surface (custom ones by their
+    // expression, heightmaps by id) and resolution. the least recently used
+    // go once they add up to more than kMeshCacheBudget.
+    struct CachedMesh {
+        std::vector<float> heights;
+        uint64_t last_used = 0;
+    };
+    std::map<std::pair<std::string, int>, CachedMesh> mesh_cache;
+    uint64_t mesh_cache_clock = 0;
+    std::mutex mesh_mutex;
+    // surfaces are built on surface_thread. every request bumps the
+    // generation; results of older generations are dropped.
+    std::thread surface_thread;
+    std::atomic<int> surface_generation{0};
+    // for short jobs the GUI thread waits on (meshes, the particle swarm).
+    // not thread_pool: waiting on that one could pick up a long basin map chunk.
+    ThreadPool frame_pool;
+    // steps the descents in overview mode. ~PlotArea pauses it before the
+    // animations, and with them the descents, are destroyed.
+    SimulationThread simulation;
+
+    // basin map: computed on basin_thread, painted into the surface texture
+    // row by row as basin_timer finds finished rows
+    Animation* basin_descent = nullptr;
+    std::unique_ptr<ThreadPool> thread_pool;
+    std::unique_ptr<BasinMap> basin_map;
+    std::thread basin_thread;
+    QTimer basin_timer;
+    QImage basin_image;
+
+    // trajectories loaded from a file
+    std::vector<std::unique_ptr<Line>> overlays;
+
+    // many particles per method, started all over the surface (overview mode)
+    std::unique_ptr<ParticleSwarm> swarm;
 
     void initializeSurface();
+    void initializeStartingPositions();
+    // a surface to switch to. the expression and heightmap are what
+    // Function::custom and Function::heightmap are to be, the current ones
+    // unless changed; other surfaces ignore them.
+    struct SurfaceChoice {
+        explicit SurfaceChoice(Function::FunctionName function_name)
+            : function_name(function_name), expression(Surface::customExpression()),
+              heightmap(Surface::heightmap()) {}
+        Function::FunctionName function_name;
+        std::shared_ptr<const Expression> expression;
+        std::shared_ptr<const Heightmap> heightmap;
+    };
+    QSurfaceDataArray* buildSurfaceArray(const SurfaceChoice& surface,
+                                         int resolution, int generation);
+    // drop the least recently used meshes other than keep until the cache is
+    // back within kMeshCacheBudget. call with mesh_mutex held.
+    void evictMeshes(const std::pair<std::string, int>& keep);
+    // switch to (or rebuild) a surface in the background
+    void requestSurface(const SurfaceChoice& surface);
+    void applySurface(const SurfaceChoice& surface, int generation,
+                      QSurfaceDataArray* data_array);
     void initializeAxes();
     void initializeAnimations();
+    void setSurface(Function::FunctionName function_name);
+    void updateTimeline();
+    void startBasinMap();
+    void stopBasinMap();
+    void updateBasinMap();
 };
 
 #endif // PLOT_H
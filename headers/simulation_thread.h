@@ -0,0 +1,103 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gradient_descent.h"
+#include "point.h"
+#include "spsc_queue.h"
+#include "timeline.h"
+
+// ~4 seconds of samples at the default pace
+const size_t kSampleQueueCapacity = 256;
+
+
+// what the app draws of a descent, copied out after a tick of gradient steps
+struct DescentSample {
+    Point position;
+    Point gradient;
+    Point delta;
+    Point momentum;
+    Point grad_sum_of_squared;
+    double learning_rate = 0.;
+    bool converged = false;
+    int step = 0; // gradient steps taken so far
+};
+
+DescentSample takeSample(GradientDescent& descent, int step);
+
+
+// Steps a set of descents on a thread of its own, paced to the animation: every
+// tick it takes steps_per_tick gradient steps of each descent and pushes one
+// sample per descent into that descent's queue. The app only drains the
+// queues, so slow surfaces or big speedups never stall the UI, and a UI that
+// is busy never stalls the stepping.
+//
+// The descents are shared with the app. Only touch them (reset them, move
+// their starting point, change the surface...) while the thread is paused.
+// New hyperparameters can be published at any time.
+class SimulationThread {
+public:
+    SimulationThread();
+    ~SimulationThread();
+
+    // the thread steps descent, records its steps in timeline and pushes its
+    // samples into queue. none of them is owned. only call while paused.
+    void addDescent(GradientDescent* descent, SpscQueue<DescentSample>* queue,
+                    Timeline* timeline);
+
+    // returns once no tick is in progress any more
+    void pause();
+    void resume();
+    bool isRunning();
+    void setSpeed(int steps_per_tick, int tick_interval_ms);
+    // forget samples that didn't fit into a full queue, e.g. after a reset or
+    // a seek. only call while paused, from the thread that drains the queues.
+    void discardPendingSamples();
+
+    // pauses for as long as it lives, then resumes if it was running
+    class ScopedPause {
+    public:
+        explicit ScopedPause(SimulationThread& simulation)
+            : simulation(simulation),
+              was_running(simulation.isRunning())
+        {
+            simulation.pause();
+        }
+        ~ScopedPause(){if (was_running) simulation.resume();}
+
+    private:
+        SimulationThread& simulation;
+        bool was_running;
+    };
+
+private:
+    struct Channel {
+        GradientDescent* descent;
+        SpscQueue<DescentSample>* queue;
+        Timeline* timeline;
+        // the latest sample that didn't fit into the queue. it is retried (or
+        // replaced by a newer one) next tick, so the app always ends up with
+        // the latest state even if it missed some in between.
+        DescentSample pending;
+        bool has_pending;
+        bool sent_converged;
+    };
+
+    std::vector<Channel> channels;
+    std::thread thread;
+    std::mutex mutex; // held by the thread while it runs a tick
+    std::condition_variable wake;
+    bool running = false;
+    bool stopping = false;
+    int steps_per_tick = 1;
+    int tick_interval = 15; // ms
+
+    void run();
+    void tick();
+};
+
+#endif // SIMULATIONTHREAD_H
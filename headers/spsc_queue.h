@@ -0,0 +1,70 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+
+// Fixed-size ring buffer for exactly one producer thread and one consumer
+// thread. Neither side ever blocks or takes a lock: push fails when the ring
+// is full and pop fails when it is empty.
+template <typename T>
+class SpscQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity)
+        : head(0),
+          tail(0)
+    {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    size_t capacity() const {return buffer.size();}
+
+    // producer only. returns false (and drops item) if the ring is full.
+    bool push(const T& item){
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == buffer.size()){
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == buffer.size()) return false;
+        }
+        buffer[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only. returns false if the ring is empty.
+    bool pop(T& item){
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail){
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) return false;
+        }
+        item = buffer[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only. drops everything that is queued.
+    void clear(){
+        T item;
+        while (pop(item)) {}
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t mask;
+    // head and tail count up forever; the slot is the count modulo the size.
+    // each is written by one side only and lives on its own cache line, next
+    // to that side's cached copy of the other index.
+    alignas(64) std::atomic<size_t> head; // next slot to read
+    size_t cached_tail = 0;
+    alignas(64) std::atomic<size_t> tail; // next slot to write
+    size_t cached_head = 0;
+};
+
+#endif // SPSCQUEUE_H
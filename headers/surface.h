@@ -0,0 +1,270 @@
+#ifndef SURFACE_H
+#define SURFACE_H
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "point.h"
+
+
+namespace Function{
+// custom: the user's expression, Surface::customExpression() (expression.h)
+// heightmap: a loaded grid, Surface::heightmap() (heightmap.h)
+enum FunctionName {local_minimum, global_minimum, saddle_point, ecliptic_bowl,
+                  hills, plateau, custom, heightmap};
+}
+
+namespace Gradient{
+// analytic: hand-derived gradient, computed together with f in one evaluation
+// finite_difference: central difference, 4 evaluations of f
+enum GradientMethod {analytic, finite_difference};
+}
+
+const double kFiniteDiffEpsilon = 1e-12;
+
+
+namespace Surface{
+
+// the identifier of a surface as text, e.g. "local_minimum"
+const char* functionName(Function::FunctionName function_name);
+// returns false if name is not a surface
+bool functionFromName(const std::string& name, Function::FunctionName& function_name);
+
+// a surface evaluated at n points at once: out[i] = f(xs[i], zs[i]). e.g.
+// GradientDescent::f
+typedef void (*BatchFunction)(const double* xs, const double* zs, double* out, size_t n);
+
+
+// exp, sin and cos of the surfaces, from the Cephes polynomials. The vector
+// kernels (surface_kernels_simd.inl) do the same operations lane by lane, so a
+// point has the same value whether it is evaluated alone or in a batch, on any
+// instruction set. exp is inf above kExpMax and clamps arguments below kExpMin
+// to keep the result a normal double; NaN stays NaN. sin and cos lose accuracy
+// beyond |x| ~ 1e8.
+namespace Math{
+const double kExpMin = -708.;
+const double kExpMax = 709.;
+const double kLog2e = 1.4426950408889634073599;
+const double kLn2Hi = 6.93145751953125e-1;
+const double kLn2Lo = 1.42860682030941723212e-6;
+const double kExpP[3] = {1.26177193074810590878e-4, 3.02994407707441961300e-2,
+                         9.99999999999999999910e-1};
+const double kExpQ[4] = {3.00198505138664455042e-6, 2.52448340349684104192e-3,
+                         2.27265548208155028766e-1, 2.00000000000000000009e0};
+// 2^52 + 1023: adding an integral k puts k + 1023 in the low mantissa bits
+const double kPow2Bias = 4503599627370496. + 1023.;
+
+const double kTwoOverPi = 6.36619772367581343076e-1;
+// pi / 2 in three parts; k * kPiOver2Hi is exact for |k| < 2^29
+const double kPiOver2Hi = 1.57079625129699707031e0;
+const double kPiOver2Mid = 7.54978941586159635336e-8;
+const double kPiOver2Lo = 5.39030285815811905290e-15;
+const double kSinP[6] = {1.58962301576546568060e-10, -2.50507477628578072866e-8,
+                         2.75573136213857245213e-6, -1.98412698295895385996e-4,
+                         8.33333333332211858878e-3, -1.66666666666666307295e-1};
+const double kCosP[6] = {-1.13585365213876817300e-11, 2.08757008419747316778e-9,
+                         -2.75573141792967388112e-7, 2.48015872888517045348e-5,
+                         -1.38888888888730564116e-3, 4.16666666666665929218e-2};
+
+// as maxpd / minpd: b if either is NaN
+inline double max(double a, double b){return a > b ? a : b;}
+inline double min(double a, double b){return a < b ? a : b;}
+
+// 2^k for integral k in [-1022, 1023]
+inline double pow2(double k){
+    double biased = k + kPow2Bias;
+    uint64_t bits;
+    memcpy(&bits, &biased, sizeof(bits));
+    bits <<= 52;
+    memcpy(&biased, &bits, sizeof(bits));
+    return biased;
+}
+
+inline double exp(double x){
+    /* exp(x) = 2^k exp(r) with |r| <= ln(2) / 2, exp(r) from a Pade form.
+     * NaN gets through the clamp (min and max return their second operand)
+     * and on into the result.
+     */
+    if (x > kExpMax) return HUGE_VAL;
+    x = min(kExpMax, max(kExpMin, x));
+    double k = floor(x * kLog2e + 0.5);
+    double r = x - k * kLn2Hi;
+    r = r - k * kLn2Lo;
+    double rr = r * r;
+    double p = r * ((kExpP[0] * rr + kExpP[1]) * rr + kExpP[2]);
+    double q = ((kExpQ[0] * rr + kExpQ[1]) * rr + kExpQ[2]) * rr + kExpQ[3];
+    r = p / (q - p);
+    r = 1. + 2. * r;
+    return r * pow2(k);
+}
+
+// sin(x) for shift 0, cos(x) = sin(x + pi / 2) for shift 1
+inline double sinOrCos(double x, double shift){
+    /* x = k pi / 2 + r with |r| <= pi / 4. quadrant q = (k + shift) mod 4
+     * picks +sin(r), +cos(r), -sin(r) or -cos(r); the selection multiplies by
+     * exactly 0 and 1, so it needs no branches in the vector kernels
+     */
+    double k = floor(x * kTwoOverPi + 0.5);
+    double r = x - k * kPiOver2Hi;
+    r = r - k * kPiOver2Mid;
+    r = r - k * kPiOver2Lo;
+    double q = k + shift;
+    q = q - 4. * floor(q * 0.25);
+    double half_q = floor(q * 0.5);
+    double odd = q - 2. * half_q;
+    double sign = 1. - 2. * half_q;
+
+    double rr = r * r;
+    double sin_r = r + r * rr * (((((kSinP[0] * rr + kSinP[1]) * rr + kSinP[2]) * rr
+                                   + kSinP[3]) * rr + kSinP[4]) * rr + kSinP[5]);
+    double cos_r = 1. - 0.5 * rr + rr * rr * (((((kCosP[0] * rr + kCosP[1]) * rr
+                                   + kCosP[2]) * rr + kCosP[3]) * rr + kCosP[4]) * rr + kCosP[5]);
+    return sign * (sin_r * (1. - odd) + cos_r * odd);
+}
+
+inline double sin(double x){return sinOrCos(x, 0.);}
+inline double cos(double x){return sinOrCos(x, 1.);}
+}
+
+
+// Each surface is its own type so that code looping over many points can be
+// instantiated per surface (see Surface::dispatch) with f fully inlined,
+// instead of switching on Function::FunctionName for every point. Most code
+// should call SurfaceKernels (surface_kernels.h), which evaluates many points
+// per call with vector instructions.
+
+struct LocalMinimum {
+    static double f(double x, double z){
+        z *= 1.4;
+        return -2 * Math::exp(-((x - 1) * (x - 1) + z * z) / .2) -
+                6. * Math::exp(-((x + 1) * (x + 1) + z * z) / .2) +
+                x * x + z * z;
+    }
+
+    static double valueAndGradient(double x, double z, Point& grad){
+        z *= 1.4;
+        double e1 = Math::exp(-((x - 1) * (x - 1) + z * z) / .2);
+        double e2 = Math::exp(-((x + 1) * (x + 1) + z * z) / .2);
+        grad.x = 20. * (x - 1) * e1 + 60. * (x + 1) * e2 + 2 * x;
+        grad.z = 1.4 * (20. * z * e1 + 60. * z * e2 + 2 * z);
+        return -2 * e1 - 6. * e2 + x * x + z * z;
+    }
+};
+
+
+struct GlobalMinimum {
+    static double f(double x, double z){
+        return x * x + z * z;
+    }
+
+    static double valueAndGradient(double x, double z, Point& grad){
+        grad.x = 2 * x;
+        grad.z = 2 * z;
+        return x * x + z * z;
+    }
+};
+
+
+struct SaddlePoint {
+    static double f(double x, double z){
+        return Math::sin(x) + z * z;
+    }
+
+    static double valueAndGradient(double x, double z, Point& grad){
+        grad.x = Math::cos(x);
+        grad.z = 2 * z;
+        return Math::sin(x) + z * z;
+    }
+};
+
+
+struct EclipticBowl {
+    static double f(double x, double z){
+        x /= 2.;
+        z /= 2.;
+        return -Math::exp(-(x * x + 5 * z * z)) + x * x + 0.5 * z * z;
+    }
+
+    static double valueAndGradient(double x, double z, Point& grad){
+        x /= 2.;
+        z /= 2.;
+        double e = Math::exp(-(x * x + 5 * z * z));
+        grad.x = 0.5 * (2 * x * e + 2 * x);
+        grad.z = 0.5 * (10 * z * e + z);
+        return -e + x * x + 0.5 * z * z;
+    }
+};
+
+
+struct Hills {
+    static double f(double x, double z){
+        z *= 1.4;
+        return  2 * Math::exp(-((x - 1) * (x - 1) + z * z) / .2) +
+                6. * Math::exp(-((x + 1) * (x + 1) + z * z) / .2) -
+                2 * Math::exp(-((x - 1) * (x  - 1) + (z + 1) * (z + 1)) / .2) +
+                x * x + z * z;
+    }
+
+    static double valueAndGradient(double x, double z, Point& grad){
+        z *= 1.4;
+        double e1 = Math::exp(-((x - 1) * (x - 1) + z * z) / .2);
+        double e2 = Math::exp(-((x + 1) * (x + 1) + z * z) / .2);
+        double e3 = Math::exp(-((x - 1) * (x  - 1) + (z + 1) * (z + 1)) / .2);
+        grad.x = -20. * (x - 1) * e1 - 60. * (x + 1) * e2 + 20. * (x - 1) * e3 + 2 * x;
+        grad.z = 1.4 * (-20. * z * e1 - 60. * z * e2 + 20. * (z + 1) * e3 + 2 * z);
+        return 2 * e1 + 6. * e2 - 2 * e3 + x * x + z * z;
+    }
+};
+
+
+struct Plateau {
+    static double f(double x, double z){
+        x *= 10;
+        z *= 10;
+        double r = sqrt(z * z + x * x) + 0.01;
+        return -Math::sin(r) / r + 0.01 * r * r;
+    }
+
+    static double valueAndGradient(double x, double z, Point& grad){
+        x *= 10;
+        z *= 10;
+        double s = sqrt(z * z + x * x);
+        double r = s + 0.01;
+        double sin_r = Math::sin(r);
+        // d/dr of the radial profile, then chain rule through r = |(x, z)|
+        // (the gradient of |(x, z)| is undefined at the origin; use 0 there:
+        // x and z are 0 whenever s is, so it's enough to keep s off 0)
+        double d_dr = -(Math::cos(r) * r - sin_r) / (r * r) + 0.02 * r;
+        double s_nonzero = Math::max(s, DBL_MIN);
+        grad.x = 10 * d_dr * x / s_nonzero;
+        grad.z = 10 * d_dr * z / s_nonzero;
+        return -sin_r / r + 0.01 * r * r;
+    }
+};
+
+
+// calls visitor.template visit<S>() with S the type of the named surface.
+// use it to pick the surface once, outside of a loop over points. custom and
+// heightmap have no type and visit nothing; SurfaceKernels runs their
+// Expression or Heightmap instead.
+template <typename Visitor>
+inline void dispatch(Function::FunctionName function_name, Visitor& visitor){
+    switch (function_name){
+    case Function::local_minimum: visitor.template visit<LocalMinimum>(); break;
+    case Function::global_minimum: visitor.template visit<GlobalMinimum>(); break;
+    case Function::saddle_point: visitor.template visit<SaddlePoint>(); break;
+    case Function::ecliptic_bowl: visitor.template visit<EclipticBowl>(); break;
+    case Function::hills: visitor.template visit<Hills>(); break;
+    case Function::plateau: visitor.template visit<Plateau>(); break;
+    case Function::custom: break;
+    case Function::heightmap: break;
+    }
+}
+
+}
+
+#endif // SURFACE_H
@@ -0,0 +1,93 @@
+#ifndef SURFACEKERNELS_H
+#define SURFACEKERNELS_H
+
+#include <stddef.h>
+
+#include "expression.h"
+#include "heightmap.h"
+#include "surface.h"
+
+
+// The surfaces evaluated at many points per call. On x86 CPUs that support it
+// the points go 4 (AVX2) or 8 (AVX-512) per instruction, exp, sin and cos
+// included; elsewhere, and for the last few points, a scalar loop does the
+// same computation in the same order. The instruction set is the one
+// BatchKernels::instructionSet() picks.
+//
+// Function::custom runs Surface::customExpression()'s programs, a block of
+// points at a time, each instruction of the program vectorized the same way.
+// Calls with only a few points, like a single ball's step, run the scalar
+// program on the stack.
+// Function::heightmap samples Surface::heightmap(), gathering the 16 samples
+// around each point.
+//
+// xs[i], zs[i] is point i. The outputs must not overlap the inputs.
+namespace SurfaceKernels{
+
+// out[i] = f(xs[i], zs[i])
+void evaluate(Function::FunctionName function_name,
+              const double* xs, const double* zs, double* out, size_t n);
+// f (unless out is nullptr) and its analytic gradient
+void valueAndGradient(Function::FunctionName function_name,
+                      const double* xs, const double* zs,
+                      double* out, double* grad_x, double* grad_z, size_t n);
+// the gradient by either method; finite differences take 4 evaluations
+void gradient(Function::FunctionName function_name, Gradient::GradientMethod method,
+              const double* xs, const double* zs,
+              double* grad_x, double* grad_z, size_t n);
+
+// the same for a given expression or heightmap rather than Function::custom's
+// or Function::heightmap's
+void evaluate(const Expression& expression,
+              const double* xs, const double* zs, double* out, size_t n);
+void valueAndGradient(const Expression& expression,
+                      const double* xs, const double* zs,
+                      double* out, double* grad_x, double* grad_z, size_t n);
+void evaluate(const Heightmap& heightmap,
+              const double* xs, const double* zs, double* out, size_t n);
+void valueAndGradient(const Heightmap& heightmap,
+                      const double* xs, const double* zs,
+                      double* out, double* grad_x, double* grad_z, size_t n);
+
+// the scalar kernels on points [begin, end). also used for the tail. they
+// don't handle Function::custom or Function::heightmap.
+void evaluateScalar(Function::FunctionName function_name,
+                    const double* xs, const double* zs, double* out,
+                    size_t begin, size_t end);
+void valueAndGradientScalar(Function::FunctionName function_name,
+                            const double* xs, const double* zs,
+                            double* out, double* grad_x, double* grad_z,
+                            size_t begin, size_t end);
+
+// the vector kernels handle the largest prefix of the points that is a
+// multiple of the vector width and return its length. only call them if the
+// CPU supports the instruction set.
+size_t evaluateAvx2(Function::FunctionName function_name,
+                    const double* xs, const double* zs, double* out, size_t n);
+size_t evaluateAvx512(Function::FunctionName function_name,
+                      const double* xs, const double* zs, double* out, size_t n);
+size_t valueAndGradientAvx2(Function::FunctionName function_name,
+                            const double* xs, const double* zs,
+                            double* out, double* grad_x, double* grad_z, size_t n);
+size_t valueAndGradientAvx512(Function::FunctionName function_name,
+                              const double* xs, const double* zs,
+                              double* out, double* grad_x, double* grad_z, size_t n);
+
+// run every instruction of program on points [begin, end) of registers,
+// where registers[r] is the block of register r
+void runProgramScalar(const ExpressionProgram& program, double* const* registers,
+                      size_t begin, size_t end);
+size_t runProgramAvx2(const ExpressionProgram& program, double* const* registers, size_t n);
+size_t runProgramAvx512(const ExpressionProgram& program, double* const* registers, size_t n);
+
+// heightmap values (if out isn't nullptr) and gradients (if grad_x isn't)
+void sampleHeightmapScalar(const Heightmap& heightmap, const double* xs, const double* zs,
+                           double* out, double* grad_x, double* grad_z,
+                           size_t begin, size_t end);
+size_t sampleHeightmapAvx2(const Heightmap& heightmap, const double* xs, const double* zs,
+                           double* out, double* grad_x, double* grad_z, size_t n);
+size_t sampleHeightmapAvx512(const Heightmap& heightmap, const double* xs, const double* zs,
+                             double* out, double* grad_x, double* grad_z, size_t n);
+}
+
+#endif // SURFACEKERNELS_H
@@ -0,0 +1,63 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <vector>
+
+#include "gradient_descent.h"
+#include "point.h"
+#include "surface.h"
+
+class ThreadPool;
+
+
+// one run of a sweep: a surface and the settings to descend it with
+struct SweepConfiguration {
+    Function::FunctionName function_name = Function::local_minimum;
+    Hyperparameters hyperparameters;
+};
+
+
+struct SweepResult {
+    SweepConfiguration configuration;
+    size_t num_converged = 0;   // starting points that converged
+    int steps_to_converge = -1; // steps until the last one converged; -1 if not all did
+    double final_loss = 0.;     // mean over the starting points
+    double wall_time = 0.;      // seconds
+};
+
+
+// the values to try. an empty list keeps the value of the base configuration.
+struct SweepSpace {
+    std::vector<Function::FunctionName> function_names;
+    std::vector<double> learning_rates;
+    std::vector<double> decay_rates;
+    std::vector<double> discount_factors;
+    std::vector<double> squared_discount_factors;
+    std::vector<double> beta1s;
+    std::vector<double> beta2s;
+};
+
+
+namespace Sweep{
+
+// every combination of the listed values
+std::vector<SweepConfiguration> grid(const SweepSpace& space,
+                                     const SweepConfiguration& base);
+// num_samples configurations, each hyperparameter drawn uniformly between the
+// smallest and largest listed value (the learning rate log-uniformly) and the
+// surface drawn from the listed ones. the same seed gives the same samples.
+std::vector<SweepConfiguration> random(const SweepSpace& space,
+                                       const SweepConfiguration& base,
+                                       int num_samples, unsigned seed);
+
+// runs every configuration from every starting point until all of them
+// converged or max_steps steps were taken, one configuration per task.
+// results are in the order of configurations.
+std::vector<SweepResult> run(Optimizer::OptimizerName optimizer_name,
+                             const std::vector<SweepConfiguration>& configurations,
+                             const std::vector<Point>& starting_points,
+                             int max_steps, ThreadPool& pool);
+
+}
+
+#endif // SWEEP_H
@@ -0,0 +1,63 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A fixed set of worker threads with one task deque each. A worker runs its
+// own tasks newest first and, when it runs out, steals the oldest task of
+// another worker. Tasks of very different lengths (e.g. descents that
+// converge after 10 or after 100000 steps) therefore keep every core busy
+// without any up-front partitioning.
+class ThreadPool {
+public:
+    // num_threads <= 0: one thread per hardware thread
+    explicit ThreadPool(int num_threads = 0);
+    ~ThreadPool();
+
+    int numThreads() const {return int(threads.size());}
+
+    // queue a task. a task submitted from one of the pool's workers goes to
+    // that worker's own deque, so recursive splitting stays local.
+    void submit(std::function<void()> task);
+    // run queued tasks on the calling thread too, until every task submitted
+    // so far has finished
+    void wait();
+    // calls body(begin, end) on consecutive sub-ranges of at most grain
+    // elements of [0, size), in parallel. returns when all have finished.
+    void parallelFor(size_t size, size_t grain,
+                     const std::function<void(size_t, size_t)>& body);
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> num_pending;
+    // tasks in the deques, not yet taken. raised under sleep_mutex, so a
+    // worker that checks it under the lock before sleeping can't miss a task
+    std::atomic<int> num_queued;
+    std::atomic<unsigned> next_queue;
+    bool stopping = false;
+    std::mutex sleep_mutex;
+    std::condition_variable wake_workers;
+    std::condition_variable all_done;
+
+    // queue index of the calling thread, or -1 if it isn't one of ours
+    int currentQueue() const;
+    bool popOrSteal(int queue_index, std::function<void()>& task);
+    void runTask(std::function<void()>& task);
+    void workerLoop(int queue_index);
+};
+
+#endif // THREADPOOL_H
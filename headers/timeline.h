@@ -0,0 +1,55 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <atomic>
+#include <vector>
+
+#include "gradient_descent.h"
+
+const int kCheckpointInterval = 256;
+
+
+// The history of one descent, kept as a snapshot every checkpoint_interval
+// steps. Seeking to a step restores the checkpoint at or before it and
+// re-simulates the remaining (fewer than checkpoint_interval) steps, so it
+// takes the same short time for step 10 as for step 10 million.
+//
+// The hyperparameters can change while the descent runs, so the timeline also
+// records every set the descent took into use and from which step on. The
+// re-simulated steps use the sets they were first taken with; after a seek the
+// descent carries on with the set it had before.
+class Timeline {
+public:
+    explicit Timeline(int checkpoint_interval = kCheckpointInterval);
+
+    // forget everything and record the current state of descent as step 0
+    void start(GradientDescent& descent);
+    // call after every gradient step that moved descent. anything recorded
+    // past the current step (i.e. after a seek back) is dropped.
+    void recordStep(GradientDescent& descent);
+    // put descent into its state after step steps, clamped to [0, length()].
+    // a newly published hyperparameter set stays pending.
+    void seek(GradientDescent& descent, int step);
+
+    // these two may be read from any thread
+    int currentStep() const {return current_step;}
+    int length() const {return m_length;} // the last recorded step
+
+private:
+    // step and the ones after it were taken with params
+    struct HyperparameterChange {
+        int step;
+        Hyperparameters params;
+    };
+
+    const int checkpoint_interval;
+    std::vector<DescentState> checkpoints; // checkpoints[k] is step k * checkpoint_interval
+    std::vector<HyperparameterChange> changes; // by step
+    unsigned recorded_version = 0;
+    // after a seek the next step may use another set than the recorded ones
+    bool record_next_hyperparameters = false;
+    std::atomic<int> current_step;
+    std::atomic<int> m_length;
+};
+
+#endif // TIMELINE_H
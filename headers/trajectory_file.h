@@ -0,0 +1,138 @@
+#ifndef TRAJECTORYFILE_H
+#define TRAJECTORYFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "gradient_descent.h"
+#include "mapped_file.h"
+#include "point.h"
+
+// Binary trajectory file, for runs too long to keep as text:
+//
+//   TrajectoryHeader
+//   starting points: num_trajectories x (double x, double z)
+//   step records:    one per recorded step, each num_trajectories x (float dx, float dz)
+//
+// Record i is taken after i * step_interval gradient steps, except the last,
+// which is taken where the run stopped: after num_steps steps. Each record
+// holds, per trajectory, the movement since the previous record.
+// The deltas are taken relative to the position a reader reconstructs (not
+// the exact one), so rounding to float never accumulates. Trajectories that
+// stopped (converged) keep writing zero deltas. All values are in the
+// machine's native byte order (little endian on every platform we build for).
+
+const char kTrajectoryMagic[8] = {'G', 'D', 'T', 'R', 'A', 'J', '\0', '\0'};
+const uint32_t kTrajectoryVersion = 2;
+
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t function_name;     // Function::FunctionName
+    uint32_t optimizer_name;    // Optimizer::OptimizerName
+    uint32_t gradient_method;   // Gradient::GradientMethod
+    uint32_t use_bias_correction;
+    uint32_t step_interval;     // gradient steps between two records
+    uint64_t num_trajectories;
+    double learning_rate;
+    double decay_rate;
+    double discount_factor;
+    double squared_discount_factor;
+    double beta1;
+    double beta2;
+    // gradient steps of the whole run, written when the file is closed; 0 in
+    // a file cut short
+    uint64_t num_steps;
+
+    static TrajectoryHeader create(Function::FunctionName function_name,
+                                   Optimizer::OptimizerName optimizer_name,
+                                   const Hyperparameters& hyperparameters,
+                                   size_t num_trajectories, int step_interval);
+    Hyperparameters hyperparameters() const;
+};
+
+
+struct TrajectoryDelta {
+    float dx;
+    float dz;
+};
+
+
+// Appends step records through a large buffer, so a batch of balls can be
+// recorded every step without a system call per step.
+class TrajectoryWriter {
+public:
+    TrajectoryWriter() {}
+    ~TrajectoryWriter() {close();}
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // header.num_trajectories must match starting_points
+    bool open(const std::string& path, const TrajectoryHeader& header,
+              const std::vector<Point>& starting_points);
+    // record the current position of every trajectory, after step gradient
+    // steps: the next multiple of the step interval or, for the last record,
+    // where the run stopped
+    void append(const double* x, const double* z, uint64_t step);
+    // flushes, puts the step of the last record in the header as num_steps
+    // and closes; returns false if anything failed to write
+    bool close();
+
+private:
+    FILE* file = nullptr;
+    std::vector<char> buffer;
+    size_t buffer_used = 0;
+    bool failed = false;
+    uint64_t last_step = 0;
+    std::vector<double> last_x, last_z; // as a reader will reconstruct them
+
+    void write(const void* data, size_t size);
+    void flush();
+};
+
+
+// Reads a trajectory file through a memory mapping; nothing is copied, so
+// files of any length can be replayed.
+class TrajectoryReader {
+public:
+    // returns false if the file can't be mapped or isn't a trajectory file
+    bool open(const std::string& path);
+
+    const TrajectoryHeader& header() const {return m_header;}
+    size_t numTrajectories() const {return size_t(m_header.num_trajectories);}
+    // complete records in the file (a file cut short by a crash is fine)
+    uint64_t numRecords() const {return num_records;}
+    // the gradient steps taken before a record (0: the starting points)
+    uint64_t step(uint64_t record) const;
+    Point startingPoint(size_t trajectory) const;
+
+    // calls callback(record, position) for the starting point (record 0) and
+    // after every record of one trajectory
+    template <typename Callback>
+    void replay(size_t trajectory, Callback callback) const{
+        Point p = startingPoint(trajectory);
+        callback(uint64_t(0), p);
+        const unsigned char* record = records + trajectory * sizeof(TrajectoryDelta);
+        const size_t record_size = numTrajectories() * sizeof(TrajectoryDelta);
+        for (uint64_t i = 1; i <= num_records; i++, record += record_size){
+            TrajectoryDelta delta;
+            memcpy(&delta, record, sizeof(delta));
+            p.x += delta.dx;
+            p.z += delta.dz;
+            callback(i, p);
+        }
+    }
+
+private:
+    MappedFile file;
+    TrajectoryHeader m_header;
+    const unsigned char* starting_points = nullptr;
+    const unsigned char* records = nullptr;
+    uint64_t num_records = 0;
+};
+
+#endif // TRAJECTORYFILE_H
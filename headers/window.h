@@ -18,6 +18,7 @@
 #include "plot_area.h"
 
 QT_BEGIN_NAMESPACE
+class QCheckBox;
 class QGroupBox;
 QT_END_NAMESPACE
 
@@ -34,12 +35,17 @@ private:
     void setupKeyboardShortcuts();
 
     QGroupBox* createControlGroup();
+    QGroupBox* createTimelineGroup();
     QPushButton *createZoomButton(int is_zoomout);
     QPushButton* createToggleAnimationButton();
     QPushButton* createRestartAnimationButton();
+    QPushButton* createLoadTrajectoryButton();
+    QPushButton* createLoadHeightmapButton();
     QComboBox* createPlaybackSpeedBox();
+    QComboBox* createSurfaceResolutionBox();
 
     QComboBox* createFunctionSelector();
+    QLayout* createCustomSurfaceBox();
     QTabWidget* createViewTabs();
 
     QGroupBox* createDescentGroup(Animation* animation,
@@ -53,7 +59,10 @@ private:
     QGroupBox *createQHAdamGroup();
 
     QLayout* createLearningRateBox(GradientDescent* descent);
-    QDoubleSpinBox* createDecayBox(double& val);
+    // the boxes publish every edit to the descent as a new set of
+    // hyperparameters, so they are safe to use while it runs
+    QDoubleSpinBox* createDecayBox(GradientDescent* descent, double Hyperparameters::* field);
+    QCheckBox* createBiasCorrectionBox(GradientDescent* descent);
 
 };
 
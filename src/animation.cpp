@@ -1,33 +1,84 @@
+#include <algorithm>
+
 #include "animation.h"
 
-void Animation::triggerSimpleAnimation(int animation_speedup,
+void Animation::triggerSimpleAnimation(
      bool show_gradient, bool show_adjusted_gradient,
      bool show_momentum, bool show_gradient_squared, bool show_path){
-    if (descent->isConverged()) {
-        if (m_visible) path->setVisible(show_path);
+    /* the simulation thread does the stepping. take everything it produced
+     * since the last frame: every sample extends the path, and the latest
+     * one places the ball and the arrows.
+     */
+    DescentSample sample;
+    bool has_new_sample = false;
+    while (samples.pop(sample)){
+        // after a seek back, the new steps replace the ones recorded before
+        while (!path_history.empty() && path_history.back().step > last_sample.step)
+            path_history.pop_back();
+        path_history.push_back({sample.step, sample.position});
+        if (path_history.size() > kLineMaxCrosslines) decimatePathHistory();
+        path->addPoint(sample.position);
+        last_sample = sample;
+        has_new_sample = true;
+    }
+    if (!has_new_sample) {
+        if (last_sample.converged && m_visible) path->setVisible(show_path);
         return;
     }
-    Point p;
-    for (int i = 0; i < animation_speedup; i++)
-        p = descent->takeGradientStep();
-    path->addPoint(descent->position());
+    drawLastSample(show_gradient, show_adjusted_gradient, show_momentum,
+                   show_gradient_squared, show_path);
+}
+
 
+void Animation::drawLastSample(bool show_gradient, bool show_adjusted_gradient,
+     bool show_momentum, bool show_gradient_squared, bool show_path){
     if (!m_visible) return;
 
-    ball->setPositionOnSurface(p);
+    ball->setPositionOnSurface(last_sample.position);
     this->show_path = show_path;
     if (show_path) path->render();
     if (show_gradient) animateGradient();
     if (show_adjusted_gradient) animateAdjustedGradient();
     if (has_momentum && show_momentum) animateMomentum();
     if (has_gradient_squared && show_gradient_squared) animateGradientSquared();
-    if (descent->isConverged()) {
+    if (last_sample.converged) {
         cleanupAllButPath();
         ball->setVisible(true);
     }
 }
 
 
+void Animation::seek(int step){
+    // the simulation thread is paused while this runs
+    timeline.seek(*descent, step);
+    samples.clear();
+    last_sample = takeSample(*descent, timeline.currentStep());
+
+    // redraw the path up to here, from at most kLineMaxCrosslines points.
+    // keep the later points in the history in case the next seek goes
+    // forward again.
+    path->erase();
+    for (const PathPoint& point : path_history){
+        if (point.step > last_sample.step) break;
+        path->addPoint(point.position);
+    }
+    path->addPoint(last_sample.position);
+    ball->setVisible(m_visible);
+}
+
+
+void Animation::decimatePathHistory(){
+    // the same tolerance a Line starts with
+    if (path_history_tolerance == 0.){
+        PlotTransform* transform = PlotTransform::forGraph(m_graph);
+        path_history_tolerance =
+                kLineHalfWidth * std::min(transform->xRange(), transform->zRange()) / 4;
+    }
+    decimatePath(path_history, kLineMaxCrosslines, path_history_tolerance,
+                 [](const PathPoint& point){return point.position;});
+}
+
+
 void Animation::setVisible(bool visible){
     if (visible != m_visible){
         m_visible = visible;
@@ -48,11 +99,11 @@ void Animation::setVisible(bool visible){
 
 void Animation::animateGradient(){
     if (arrowX == nullptr)
-        arrowX = std::unique_ptr<Arrow>(new Arrow(m_graph, QVector3D(-1, 0, 0), kGradientColor));
+        arrowX = items->arrow(QVector3D(-1, 0, 0), kGradientColor);
     if (arrowZ == nullptr)
-        arrowZ = std::unique_ptr<Arrow>(new Arrow(m_graph, QVector3D(0, 0, -1), kGradientColor));
-    arrowX->setMagnitude(descent->gradX() * kSimpleAnimationArrowScale);
-    arrowZ->setMagnitude(descent->gradZ() * kSimpleAnimationArrowScale);
+        arrowZ = items->arrow(QVector3D(0, 0, -1), kGradientColor);
+    arrowX->setMagnitude(last_sample.gradient.x * kSimpleAnimationArrowScale);
+    arrowZ->setMagnitude(last_sample.gradient.z * kSimpleAnimationArrowScale);
     arrowX->setPosition(ball->position());
     arrowZ->setPosition(ball->position());
 }
@@ -60,11 +111,11 @@ void Animation::animateGradient(){
 
 void Animation::animateAdjustedGradient(){
     if (adjustedArrowX == nullptr)
-        adjustedArrowX = std::unique_ptr<Arrow>(new Arrow(m_graph, QVector3D(-1, 0, 0), Qt::black));
+        adjustedArrowX = items->arrow(QVector3D(-1, 0, 0), Qt::black);
     if (adjustedArrowZ == nullptr)
-        adjustedArrowZ = std::unique_ptr<Arrow>(new Arrow(m_graph, QVector3D(0, 0, -1), Qt::black));
-    adjustedArrowX->setMagnitude(-descent->delta().x / descent->learning_rate * kSimpleAnimationArrowScale);
-    adjustedArrowZ->setMagnitude(-descent->delta().z / descent->learning_rate * kSimpleAnimationArrowScale);
+        adjustedArrowZ = items->arrow(QVector3D(0, 0, -1), Qt::black);
+    adjustedArrowX->setMagnitude(-last_sample.delta.x / last_sample.learning_rate * kSimpleAnimationArrowScale);
+    adjustedArrowZ->setMagnitude(-last_sample.delta.z / last_sample.learning_rate * kSimpleAnimationArrowScale);
     adjustedArrowX->setPosition(ball->position());
     adjustedArrowZ->setPosition(ball->position());
 }
@@ -72,13 +123,11 @@ void Animation::animateAdjustedGradient(){
 
 void Animation::animateMomentum(){
     if (momentumArrowX == nullptr)
-        momentumArrowX = std::unique_ptr<Arrow>(
-                    new Arrow(m_graph, QVector3D(-1, 0, 0), kMomentumColor));
+        momentumArrowX = items->arrow(QVector3D(-1, 0, 0), kMomentumColor);
     if (momentumArrowZ == nullptr)
-        momentumArrowZ = std::unique_ptr<Arrow>(
-                    new Arrow(m_graph, QVector3D(0, 0, -1), kMomentumColor));
-    momentumArrowX->setMagnitude(momentum().x * kSimpleAnimationArrowScale);
-    momentumArrowZ->setMagnitude(momentum().z * kSimpleAnimationArrowScale);
+        momentumArrowZ = items->arrow(QVector3D(0, 0, -1), kMomentumColor);
+    momentumArrowX->setMagnitude(last_sample.momentum.x * kSimpleAnimationArrowScale);
+    momentumArrowZ->setMagnitude(last_sample.momentum.z * kSimpleAnimationArrowScale);
     momentumArrowX->setPosition(ball->position());
     momentumArrowZ->setPosition(ball->position());
 }
@@ -86,14 +135,14 @@ void Animation::animateMomentum(){
 
 void Animation::animateGradientSquared(){
     if (squareX == nullptr)
-        squareX = std::unique_ptr<Square>(new Square(m_graph, "x"));
+        squareX = items->square("x");
     if (squareZ == nullptr)
-        squareZ = std::unique_ptr<Square>(new Square(m_graph, "z"));
+        squareZ = items->square("z");
 
-    squareX->setArea(gradSumOfSquared().x * pow(kSimpleAnimationArrowScale, 2),
-                     signbit(descent->gradX()));
-    squareZ->setArea(gradSumOfSquared().z * pow(kSimpleAnimationArrowScale, 2),
-                     signbit(descent->gradZ()));
+    squareX->setArea(last_sample.grad_sum_of_squared.x * pow(kSimpleAnimationArrowScale, 2),
+                     signbit(last_sample.gradient.x));
+    squareZ->setArea(last_sample.grad_sum_of_squared.z * pow(kSimpleAnimationArrowScale, 2),
+                     signbit(last_sample.gradient.z));
     squareX->setPosition(ball->position());
     squareZ->setPosition(ball->position());
 }
@@ -146,22 +195,20 @@ void Animation::cleanupAll(){
 }
 
 void Animation::initializeMomentumArrows(){
-    momentumArrowX = std::unique_ptr<Arrow>(
-                new Arrow(m_graph, QVector3D(-1, 0, 0), kMomentumColor));
+    momentumArrowX = items->arrow(QVector3D(-1, 0, 0), kMomentumColor);
     momentumArrowX->setMagnitude(0);
 
-    momentumArrowZ = std::unique_ptr<Arrow>(
-                new Arrow(m_graph, QVector3D(0, 0, -1), kMomentumColor));
+    momentumArrowZ = items->arrow(QVector3D(0, 0, -1), kMomentumColor);
     momentumArrowZ->setMagnitude(0);
 }
 
 
 void Animation::initializeSquares(){
-    squareX = std::unique_ptr<Square>(new Square(m_graph, "x"));
+    squareX = items->square("x");
     squareX->setArea(0);
     squareX->setVisible(false);
 
-    squareZ = std::unique_ptr<Square>(new Square(m_graph, "z"));
+    squareZ = items->square("z");
     squareZ->setArea(0);
     squareZ->setVisible(false);
 }
@@ -183,19 +230,19 @@ void Animation::prepareDetailedAnimation(){
     timer->stop();
     ball->setVisible(true);
 
-    arrowX = std::unique_ptr<Arrow>(new Arrow(m_graph, QVector3D(-1, 0, 0), kGradientColor));
+    arrowX = items->arrow(QVector3D(-1, 0, 0), kGradientColor);
     arrowX->setMagnitude(0);
     arrowX->setVisible(false);
 
-    arrowZ = std::unique_ptr<Arrow>(new Arrow(m_graph, QVector3D(0, 0, -1), kGradientColor));
+    arrowZ = items->arrow(QVector3D(0, 0, -1), kGradientColor);
     arrowZ->setMagnitude(0);
     arrowZ->setVisible(false);
 
-    total_arrow = std::unique_ptr<Arrow>(new Arrow(m_graph));
+    total_arrow = items->arrow();
     total_arrow->setVisible(false);
     QColor color = ball_color;
     color.setAlpha(100);
-    temporary_ball = std::unique_ptr<Ball>(new Ball(m_graph, color, f));
+    temporary_ball = items->ball(color, f);
 
     if (has_momentum) initializeMomentumArrows();
     if (has_gradient_squared) initializeSquares();
@@ -205,12 +252,19 @@ void Animation::prepareDetailedAnimation(){
 
 
 void Animation::resetAnimation(){
+    // the simulation thread is paused while this runs
     descent->resetPositionAndComputeGradient();
+    timeline.start(*descent);
+    samples.clear();
+    last_sample = takeSample(*descent, 0);
+    path_history.clear();
+    path_history.push_back({0, last_sample.position});
+    path_history_tolerance = 0.;
     state = 0;
     ball->setPositionOnSurface(descent->position());
     ball->setVisible(m_visible);
     if (path != nullptr) path->erase();
-    else path = std::unique_ptr<Line>(new Line(m_graph, ball_color, f));
+    else path = std::unique_ptr<Line>(new Line(paths, ball_color, f));
     path->addPoint(descent->position());
     in_initial_state = true;
     detailed_animation_prepared = false;
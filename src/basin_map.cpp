@@ -0,0 +1,101 @@
+#include "basin_map.h"
+#include "batch_descent.h"
+#include "thread_pool.h"
+
+#include <math.h>
+#include <algorithm>
+
+// rows per task; 8 rows of a 512 wide grid make a batch of 4096 balls
+const int kRowsPerChunk = 8;
+
+
+BasinMap::BasinMap(Function::FunctionName function_name,
+                   Optimizer::OptimizerName optimizer_name,
+                   const Hyperparameters& hyperparameters,
+                   int resolution, double min_x, double max_x, double min_z, double max_z)
+    : function_name(function_name),
+      optimizer_name(optimizer_name),
+      hyperparameters(hyperparameters),
+      m_resolution(resolution),
+      min_x(min_x), max_x(max_x), min_z(min_z), max_z(max_z),
+      basins(resolution * resolution, -1),
+      steps(resolution * resolution, 0),
+      cancelled(false),
+      finished(false)
+{}
+
+
+Point BasinMap::startingPoint(int row, int column) const{
+    double step_x = m_resolution > 1 ? (max_x - min_x) / (m_resolution - 1) : 0.;
+    double step_z = m_resolution > 1 ? (max_z - min_z) / (m_resolution - 1) : 0.;
+    return Point(fmin(max_x, min_x + column * step_x),
+                 fmin(max_z, min_z + row * step_z));
+}
+
+
+void BasinMap::compute(ThreadPool& pool){
+    int num_chunks = (m_resolution + kRowsPerChunk - 1) / kRowsPerChunk;
+    pool.parallelFor(num_chunks, 1, [this](size_t begin, size_t end){
+        for (size_t chunk = begin; chunk < end; chunk++){
+            int first_row = int(chunk) * kRowsPerChunk;
+            computeRows(first_row, std::min(m_resolution, first_row + kRowsPerChunk));
+        }
+    });
+    finished = true;
+}
+
+
+void BasinMap::computeRows(int begin, int end){
+    if (cancelled) return;
+
+    std::vector<Point> points;
+    points.reserve((end - begin) * m_resolution);
+    for (int i = begin; i < end; i++){
+        for (int j = 0; j < m_resolution; j++)
+            points.push_back(startingPoint(i, j));
+    }
+
+    BatchGradientDescent descent(optimizer_name, hyperparameters);
+    descent.function_name = function_name;
+    descent.setStartingPositions(points);
+    for (int step = 0; step < max_steps; step++){
+        if (descent.numConverged() == descent.size() || cancelled) break;
+        descent.takeGradientSteps();
+    }
+    if (cancelled) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t k = 0; k < descent.size(); k++){
+        size_t cell = begin * m_resolution + k;
+        steps[cell] = descent.batchState().num_steps[k];
+        basins[cell] = descent.isConverged(k) ?
+                    findOrAddMinimum(descent.position(k)) : -1;
+    }
+    for (int i = begin; i < end; i++) finished_rows.push_back(i);
+}
+
+
+int BasinMap::findOrAddMinimum(const Point& p){
+    // called with mutex held
+    for (size_t i = 0; i < m_minima.size(); i++){
+        if (fabs(m_minima[i].x - p.x) < minimum_tolerance &&
+            fabs(m_minima[i].z - p.z) < minimum_tolerance)
+            return int(i);
+    }
+    m_minima.push_back(p);
+    return int(m_minima.size()) - 1;
+}
+
+
+std::vector<int> BasinMap::takeFinishedRows(){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<int> rows;
+    rows.swap(finished_rows);
+    return rows;
+}
+
+
+std::vector<Point> BasinMap::minima() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return m_minima;
+}
@@ -0,0 +1,135 @@
+#include "batch_descent.h"
+#include "batch_kernels.h"
+#include "surface_kernels.h"
+
+#include <algorithm>
+#include <math.h>
+
+
+void BatchState::resize(size_t n){
+    for (std::vector<double>* v : {&x, &z, &grad_x, &grad_z, &delta_x, &delta_z,
+                                   &first_moment_x, &first_moment_z,
+                                   &second_moment_x, &second_moment_z,
+                                   &beta1_pow, &beta2_pow})
+        v->resize(n);
+    converged.resize(n);
+    num_steps.resize(n);
+}
+
+
+BatchGradientDescent::BatchGradientDescent(Optimizer::OptimizerName optimizer_name,
+                                           const Hyperparameters& hyperparameters)
+    : optimizer_name(optimizer_name),
+      hyperparameters(hyperparameters),
+      function_name(GradientDescent::function_name)
+{}
+
+
+BatchGradientDescent::BatchGradientDescent(GradientDescent* prototype)
+    : BatchGradientDescent(prototype->optimizerName(),
+                           prototype->publishedHyperparameters())
+{}
+
+
+size_t BatchGradientDescent::numConverged() const{
+    size_t count = 0;
+    for (unsigned char c : state.converged) count += c;
+    return count;
+}
+
+
+double BatchGradientDescent::loss(size_t i) const{
+    double value;
+    SurfaceKernels::evaluate(function_name, &state.x[i], &state.z[i], &value, 1);
+    return value;
+}
+
+
+std::vector<double> BatchGradientDescent::losses() const{
+    std::vector<double> values(size());
+    SurfaceKernels::evaluate(function_name, state.x.data(), state.z.data(),
+                             values.data(), size());
+    return values;
+}
+
+
+void BatchGradientDescent::setStartingPositions(const std::vector<Point>& points){
+    starting_points = points;
+    state.resize(points.size());
+    resetPositionsAndComputeGradients();
+}
+
+
+void BatchGradientDescent::computeGradients(size_t begin, size_t end){
+    SurfaceKernels::gradient(function_name, GradientDescent::gradient_method,
+                             state.x.data() + begin, state.z.data() + begin,
+                             state.grad_x.data() + begin, state.grad_z.data() + begin,
+                             end - begin);
+}
+
+
+void BatchGradientDescent::resetPositionsAndComputeGradients(){
+    for (size_t i = 0; i < size(); i++){
+        state.x[i] = starting_points[i].x;
+        state.z[i] = starting_points[i].z;
+        state.delta_x[i] = state.delta_z[i] = 0.;
+        state.first_moment_x[i] = state.first_moment_z[i] = 0.;
+        state.second_moment_x[i] = state.second_moment_z[i] = 0.;
+        state.beta1_pow[i] = hyperparameters.beta1;
+        state.beta2_pow[i] = hyperparameters.beta2;
+        state.converged[i] = false;
+        state.num_steps[i] = 0;
+    }
+    computeGradients(0, size());
+}
+
+
+void BatchGradientDescent::takeGradientSteps(){
+    /* batched equivalent of GradientDescent::takeGradientStep.
+     * balls that have converged keep their position, delta and state.
+     */
+    updateConvergence();
+    updateGradientDeltas();
+    applyDeltasAndComputeGradients();
+}
+
+
+void BatchGradientDescent::updateConvergence(){
+    for (size_t i = 0; i < size(); i++){
+        if (fabs(state.grad_x[i]) < kConvergenceEpsilon &&
+            fabs(state.grad_z[i]) < kConvergenceEpsilon)
+            state.converged[i] = true;
+    }
+}
+
+
+void BatchGradientDescent::updateGradientDeltas(){
+    BatchKernels::updateGradientDeltas(optimizer_name, hyperparameters, state);
+}
+
+
+void BatchGradientDescent::applyDeltasAndComputeGradients(){
+    /* the gradients are computed for runs of consecutive blocks that still
+     * have a moving ball, one batch call per run. a converged ball in such a
+     * block keeps its position, so its gradient comes out the same again.
+     */
+    size_t run_begin = 0, run_end = 0;
+    for (size_t block = 0; block < size(); block += kGradientBlockSize){
+        size_t block_end = std::min(size(), block + kGradientBlockSize);
+        bool moving = false;
+        for (size_t i = block; i < block_end; i++){
+            if (state.converged[i]) continue;
+            moving = true;
+            state.x[i] += state.delta_x[i];
+            state.z[i] += state.delta_z[i];
+            state.num_steps[i]++;
+        }
+        if (!moving) continue;
+        if (block != run_end){
+            if (run_end > run_begin) computeGradients(run_begin, run_end);
+            run_begin = block;
+        }
+        run_end = block_end;
+    }
+    if (run_end > run_begin) computeGradients(run_begin, run_end);
+}
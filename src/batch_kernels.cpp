@@ -0,0 +1,172 @@
+#include "batch_kernels.h"
+
+#include <math.h>
+
+namespace BatchKernels{
+
+namespace {
+InstructionSet active_instruction_set = detectInstructionSet();
+}
+
+
+InstructionSet detectInstructionSet(){
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return avx512;
+    if (__builtin_cpu_supports("avx2")) return avx2;
+#endif
+    return scalar;
+}
+
+
+InstructionSet instructionSet(){
+    return active_instruction_set;
+}
+
+
+void setInstructionSet(InstructionSet instruction_set){
+    // never dispatch to something the cpu can't run
+    if (instruction_set > detectInstructionSet())
+        instruction_set = detectInstructionSet();
+    active_instruction_set = instruction_set;
+}
+
+
+const char* instructionSetName(InstructionSet instruction_set){
+    switch (instruction_set){
+    case scalar: return "scalar";
+    case avx2: return "avx2";
+    case avx512: return "avx512";
+    }
+    return "";
+}
+
+
+void updateGradientDeltas(Optimizer::OptimizerName optimizer_name,
+                          const Hyperparameters& hyperparameters,
+                          BatchState& state){
+    size_t done = 0;
+    switch (active_instruction_set){
+    case avx512:
+        done = updateGradientDeltasAvx512(optimizer_name, hyperparameters, state);
+        break;
+    case avx2:
+        done = updateGradientDeltasAvx2(optimizer_name, hyperparameters, state);
+        break;
+    case scalar:
+        break;
+    }
+    updateGradientDeltasScalar(optimizer_name, hyperparameters, state,
+                               done, state.size());
+}
+
+
+void updateGradientDeltasScalar(Optimizer::OptimizerName optimizer_name,
+                                const Hyperparameters& h,
+                                BatchState& s, size_t begin, size_t end){
+    /* same math as the updateGradientDelta() of each GradientDescent subclass,
+     * kept in the same operation order so results match bit for bit.
+     */
+    switch (optimizer_name){
+    case Optimizer::vanilla:{
+        for (size_t i = begin; i < end; i++){
+            if (s.converged[i]) continue;
+            s.delta_x[i] = -h.learning_rate * s.grad_x[i];
+            s.delta_z[i] = -h.learning_rate * s.grad_z[i];
+        }
+        break;
+    }
+    case Optimizer::momentum:{
+        for (size_t i = begin; i < end; i++){
+            if (s.converged[i]) continue;
+            s.delta_x[i] = h.decay_rate * s.delta_x[i] - h.learning_rate * s.grad_x[i];
+            s.delta_z[i] = h.decay_rate * s.delta_z[i] - h.learning_rate * s.grad_z[i];
+        }
+        break;
+    }
+    case Optimizer::qhm:{
+        double adjusted_learning_rate = h.learning_rate / (1 - h.decay_rate);
+        for (size_t i = begin; i < end; i++){
+            if (s.converged[i]) continue;
+            s.first_moment_x[i] = h.decay_rate * s.first_moment_x[i] + (1 - h.decay_rate) * s.grad_x[i];
+            s.first_moment_z[i] = h.decay_rate * s.first_moment_z[i] + (1 - h.decay_rate) * s.grad_z[i];
+            s.delta_x[i] = -adjusted_learning_rate *
+                    ((1 - h.discount_factor) * s.grad_x[i] + h.discount_factor * s.first_moment_x[i]);
+            s.delta_z[i] = -adjusted_learning_rate *
+                    ((1 - h.discount_factor) * s.grad_z[i] + h.discount_factor * s.first_moment_z[i]);
+        }
+        break;
+    }
+    case Optimizer::ada_grad:{
+        for (size_t i = begin; i < end; i++){
+            if (s.converged[i]) continue;
+            s.second_moment_x[i] += s.grad_x[i] * s.grad_x[i];
+            s.second_moment_z[i] += s.grad_z[i] * s.grad_z[i];
+            s.delta_x[i] = -h.learning_rate * s.grad_x[i] / (sqrt(s.second_moment_x[i]) + kDivisionEpsilon);
+            s.delta_z[i] = -h.learning_rate * s.grad_z[i] / (sqrt(s.second_moment_z[i]) + kDivisionEpsilon);
+        }
+        break;
+    }
+    case Optimizer::rms_prop:{
+        for (size_t i = begin; i < end; i++){
+            if (s.converged[i]) continue;
+            s.second_moment_x[i] *= h.decay_rate;
+            s.second_moment_x[i] += (1 - h.decay_rate) * (s.grad_x[i] * s.grad_x[i]);
+            s.second_moment_z[i] *= h.decay_rate;
+            s.second_moment_z[i] += (1 - h.decay_rate) * (s.grad_z[i] * s.grad_z[i]);
+            s.delta_x[i] = -h.learning_rate * s.grad_x[i] / (sqrt(s.second_moment_x[i]) + kDivisionEpsilon);
+            s.delta_z[i] = -h.learning_rate * s.grad_z[i] / (sqrt(s.second_moment_z[i]) + kDivisionEpsilon);
+        }
+        break;
+    }
+    case Optimizer::adam:
+    case Optimizer::qhadam:{
+        bool is_qhadam = optimizer_name == Optimizer::qhadam;
+        for (size_t i = begin; i < end; i++){
+            if (s.converged[i]) continue;
+            // first moment (momentum)
+            s.first_moment_x[i] *= h.beta1;
+            s.first_moment_x[i] += (1 - h.beta1) * s.grad_x[i];
+            s.first_moment_z[i] *= h.beta1;
+            s.first_moment_z[i] += (1 - h.beta1) * s.grad_z[i];
+            // second moment (rmsprop)
+            s.second_moment_x[i] *= h.beta2;
+            s.second_moment_x[i] += (1 - h.beta2) * (s.grad_x[i] * s.grad_x[i]);
+            s.second_moment_z[i] *= h.beta2;
+            s.second_moment_z[i] += (1 - h.beta2) * (s.grad_z[i] * s.grad_z[i]);
+
+            double grad_sum_x = s.first_moment_x[i];
+            double grad_sum_z = s.first_moment_z[i];
+            double grad_sum_sq_x = s.second_moment_x[i];
+            double grad_sum_sq_z = s.second_moment_z[i];
+            if (h.use_bias_correction){
+                grad_sum_x /= 1 - s.beta1_pow[i];
+                grad_sum_z /= 1 - s.beta1_pow[i];
+                grad_sum_sq_x /= 1 - s.beta2_pow[i];
+                grad_sum_sq_z /= 1 - s.beta2_pow[i];
+                s.beta1_pow[i] *= h.beta1;
+                s.beta2_pow[i] *= h.beta2;
+            }
+
+            if (is_qhadam){
+                s.delta_x[i] = -h.learning_rate
+                        * ((1 - h.discount_factor) * s.grad_x[i] + h.discount_factor * grad_sum_x)
+                        / (sqrt((1 - h.squared_discount_factor) * (s.grad_x[i] * s.grad_x[i])
+                                + h.squared_discount_factor * grad_sum_sq_x)
+                           + kDivisionEpsilon);
+                s.delta_z[i] = -h.learning_rate
+                        * ((1 - h.discount_factor) * s.grad_z[i] + h.discount_factor * grad_sum_z)
+                        / (sqrt((1 - h.squared_discount_factor) * (s.grad_z[i] * s.grad_z[i])
+                                + h.squared_discount_factor * grad_sum_sq_z)
+                           + kDivisionEpsilon);
+            } else{
+                s.delta_x[i] = -h.learning_rate * grad_sum_x / (sqrt(grad_sum_sq_x) + kDivisionEpsilon);
+                s.delta_z[i] = -h.learning_rate * grad_sum_z / (sqrt(grad_sum_sq_z) + kDivisionEpsilon);
+            }
+        }
+        break;
+    }
+    }
+}
+
+}
@@ -0,0 +1,151 @@
+// Vector kernels of BatchKernels::updateGradientDeltas. This file is included
+// once per instruction set by batch_kernels_x86.cpp, inside a namespace that
+// defines the wrapper V:
+//   V::Reg, V::Mask, V::width, V::load, V::set1, V::sqrt,
+//   V::activeMask (lanes whose ball has not converged), V::none, V::store
+//   (writes only the active lanes).
+// The math is the scalar kernel's, operation for operation.
+
+struct Axis {
+    const double* grad;
+    double* delta;
+    double* first_moment;
+    double* second_moment;
+};
+
+
+static size_t update(Optimizer::OptimizerName optimizer_name,
+                     const Hyperparameters& h, BatchState& s){
+    const size_t n = s.size() - s.size() % V::width;
+    const Axis axes[2] = {
+        {s.grad_x.data(), s.delta_x.data(), s.first_moment_x.data(), s.second_moment_x.data()},
+        {s.grad_z.data(), s.delta_z.data(), s.first_moment_z.data(), s.second_moment_z.data()}};
+    const unsigned char* converged = s.converged.data();
+
+    const V::Reg one = V::set1(1.);
+    const V::Reg epsilon = V::set1(kDivisionEpsilon);
+    const V::Reg neg_learning_rate = V::set1(-h.learning_rate);
+    const V::Reg learning_rate = V::set1(h.learning_rate);
+    const V::Reg decay_rate = V::set1(h.decay_rate);
+    const V::Reg one_minus_decay_rate = V::set1(1 - h.decay_rate);
+
+    switch (optimizer_name){
+    case Optimizer::vanilla:{
+        for (size_t i = 0; i < n; i += V::width){
+            V::Mask active = V::activeMask(converged + i);
+            if (V::none(active)) continue;
+            for (const Axis& a : axes)
+                V::store(a.delta + i, neg_learning_rate * V::load(a.grad + i), active);
+        }
+        break;
+    }
+    case Optimizer::momentum:{
+        for (size_t i = 0; i < n; i += V::width){
+            V::Mask active = V::activeMask(converged + i);
+            if (V::none(active)) continue;
+            for (const Axis& a : axes)
+                V::store(a.delta + i, decay_rate * V::load(a.delta + i)
+                         - learning_rate * V::load(a.grad + i), active);
+        }
+        break;
+    }
+    case Optimizer::qhm:{
+        const V::Reg neg_adjusted_learning_rate =
+                V::set1(-(h.learning_rate / (1 - h.decay_rate)));
+        const V::Reg discount_factor = V::set1(h.discount_factor);
+        const V::Reg one_minus_discount_factor = V::set1(1 - h.discount_factor);
+        for (size_t i = 0; i < n; i += V::width){
+            V::Mask active = V::activeMask(converged + i);
+            if (V::none(active)) continue;
+            for (const Axis& a : axes){
+                V::Reg grad = V::load(a.grad + i);
+                V::Reg momentum = decay_rate * V::load(a.first_moment + i)
+                        + one_minus_decay_rate * grad;
+                V::store(a.first_moment + i, momentum, active);
+                V::store(a.delta + i, neg_adjusted_learning_rate *
+                         (one_minus_discount_factor * grad + discount_factor * momentum),
+                         active);
+            }
+        }
+        break;
+    }
+    case Optimizer::ada_grad:{
+        for (size_t i = 0; i < n; i += V::width){
+            V::Mask active = V::activeMask(converged + i);
+            if (V::none(active)) continue;
+            for (const Axis& a : axes){
+                V::Reg grad = V::load(a.grad + i);
+                V::Reg sum_of_squared = V::load(a.second_moment + i) + grad * grad;
+                V::store(a.second_moment + i, sum_of_squared, active);
+                V::store(a.delta + i, neg_learning_rate * grad /
+                         (V::sqrt(sum_of_squared) + epsilon), active);
+            }
+        }
+        break;
+    }
+    case Optimizer::rms_prop:{
+        for (size_t i = 0; i < n; i += V::width){
+            V::Mask active = V::activeMask(converged + i);
+            if (V::none(active)) continue;
+            for (const Axis& a : axes){
+                V::Reg grad = V::load(a.grad + i);
+                V::Reg sum_of_squared = V::load(a.second_moment + i) * decay_rate
+                        + one_minus_decay_rate * (grad * grad);
+                V::store(a.second_moment + i, sum_of_squared, active);
+                V::store(a.delta + i, neg_learning_rate * grad /
+                         (V::sqrt(sum_of_squared) + epsilon), active);
+            }
+        }
+        break;
+    }
+    case Optimizer::adam:
+    case Optimizer::qhadam:{
+        const bool is_qhadam = optimizer_name == Optimizer::qhadam;
+        const V::Reg beta1 = V::set1(h.beta1);
+        const V::Reg beta2 = V::set1(h.beta2);
+        const V::Reg one_minus_beta1 = V::set1(1 - h.beta1);
+        const V::Reg one_minus_beta2 = V::set1(1 - h.beta2);
+        const V::Reg discount_factor = V::set1(h.discount_factor);
+        const V::Reg one_minus_discount_factor = V::set1(1 - h.discount_factor);
+        const V::Reg squared_discount_factor = V::set1(h.squared_discount_factor);
+        const V::Reg one_minus_squared_discount_factor = V::set1(1 - h.squared_discount_factor);
+        for (size_t i = 0; i < n; i += V::width){
+            V::Mask active = V::activeMask(converged + i);
+            if (V::none(active)) continue;
+            V::Reg beta1_pow = V::load(s.beta1_pow.data() + i);
+            V::Reg beta2_pow = V::load(s.beta2_pow.data() + i);
+            for (const Axis& a : axes){
+                V::Reg grad = V::load(a.grad + i);
+                // first moment (momentum)
+                V::Reg grad_sum = V::load(a.first_moment + i) * beta1 + one_minus_beta1 * grad;
+                // second moment (rmsprop)
+                V::Reg grad_sum_sq = V::load(a.second_moment + i) * beta2
+                        + one_minus_beta2 * (grad * grad);
+                V::store(a.first_moment + i, grad_sum, active);
+                V::store(a.second_moment + i, grad_sum_sq, active);
+                if (h.use_bias_correction){
+                    grad_sum = grad_sum / (one - beta1_pow);
+                    grad_sum_sq = grad_sum_sq / (one - beta2_pow);
+                }
+                V::Reg delta;
+                if (is_qhadam){
+                    delta = neg_learning_rate
+                            * (one_minus_discount_factor * grad + discount_factor * grad_sum)
+                            / (V::sqrt(one_minus_squared_discount_factor * (grad * grad)
+                                       + squared_discount_factor * grad_sum_sq)
+                               + epsilon);
+                } else{
+                    delta = neg_learning_rate * grad_sum / (V::sqrt(grad_sum_sq) + epsilon);
+                }
+                V::store(a.delta + i, delta, active);
+            }
+            if (h.use_bias_correction){
+                V::store(s.beta1_pow.data() + i, beta1_pow * beta1, active);
+                V::store(s.beta2_pow.data() + i, beta2_pow * beta2, active);
+            }
+        }
+        break;
+    }
+    }
+    return n;
+}
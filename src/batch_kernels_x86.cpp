@@ -0,0 +1,123 @@
+#include "batch_kernels.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// Each instruction set gets its own copy of the kernels, compiled for that
+// target only. Nothing in this file may be called unless
+// BatchKernels::detectInstructionSet() reports the matching instruction set.
+
+namespace BatchKernels{
+
+#ifdef BATCH_KERNELS_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace avx2_kernels{
+struct V {
+    typedef __m256d Reg;
+    typedef __m256d Mask;
+    static const size_t width = 4;
+
+    static Reg load(const double* p){return _mm256_loadu_pd(p);}
+    static Reg set1(double value){return _mm256_set1_pd(value);}
+    static Reg sqrt(Reg v){return _mm256_sqrt_pd(v);}
+    static Mask activeMask(const unsigned char* converged){
+        int bytes;
+        memcpy(&bytes, converged, sizeof(bytes));
+        __m256i flags = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+        return _mm256_castsi256_pd(_mm256_cmpeq_epi64(flags, _mm256_setzero_si256()));
+    }
+    static bool none(Mask mask){return _mm256_movemask_pd(mask) == 0;}
+    static void store(double* p, Reg v, Mask mask){
+        _mm256_maskstore_pd(p, _mm256_castpd_si256(mask), v);
+    }
+};
+
+#include "batch_kernels_simd.inl"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// avx-512 implies fma; keep mul and add separate so results match the scalar
+// kernel. clang ignores this; the .pro files pass it -ffp-contract=off.
+#pragma GCC optimize("fp-contract=off")
+#endif
+namespace avx512_kernels{
+struct V {
+    typedef __m512d Reg;
+    typedef __mmask8 Mask;
+    static const size_t width = 8;
+    static const Mask kAll = 0xff;
+
+    static Reg load(const double* p){return _mm512_loadu_pd(p);}
+    static Reg set1(double value){return _mm512_set1_pd(value);}
+    // the unmasked intrinsics pass gcc an undefined source operand, which it
+    // warns about; the full-mask forms take a defined one and compile the same
+    static Reg sqrt(Reg v){return _mm512_mask_sqrt_pd(v, kAll, v);}
+    static Mask activeMask(const unsigned char* converged){
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(converged));
+        return _mm512_cmpeq_epi64_mask(_mm512_maskz_cvtepu8_epi64(kAll, bytes),
+                                       _mm512_setzero_si512());
+    }
+    static bool none(Mask mask){return mask == 0;}
+    static void store(double* p, Reg v, Mask mask){_mm512_mask_storeu_pd(p, mask, v);}
+};
+
+#include "batch_kernels_simd.inl"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+
+size_t updateGradientDeltasAvx2(Optimizer::OptimizerName optimizer_name,
+                                const Hyperparameters& hyperparameters,
+                                BatchState& state){
+    return avx2_kernels::update(optimizer_name, hyperparameters, state);
+}
+
+
+size_t updateGradientDeltasAvx512(Optimizer::OptimizerName optimizer_name,
+                                  const Hyperparameters& hyperparameters,
+                                  BatchState& state){
+    return avx512_kernels::update(optimizer_name, hyperparameters, state);
+}
+
+#else
+
+// no vector kernels for this compiler / architecture; the scalar kernel
+// handles the whole batch.
+size_t updateGradientDeltasAvx2(Optimizer::OptimizerName, const Hyperparameters&,
+                                BatchState&){
+    return 0;
+}
+
+
+size_t updateGradientDeltasAvx512(Optimizer::OptimizerName, const Hyperparameters&,
+                                  BatchState&){
+    return 0;
+}
+
+#endif
+
+}
@@ -0,0 +1,498 @@
+#include "expression.h"
+#include "surface.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <locale>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+namespace {
+typedef ExpressionProgram::OpCode OpCode;
+
+const int kMaxNestingDepth = 100;
+// derivative() recurses once per operation from the result down to x or z
+const int kMaxHeight = 1000;
+const int kMaxExponent = 64;
+
+
+bool isUnary(OpCode op){
+    return op == ExpressionProgram::negate || op == ExpressionProgram::sqrt ||
+           op == ExpressionProgram::exp || op == ExpressionProgram::sin ||
+           op == ExpressionProgram::cos;
+}
+
+
+// the same math the kernels run, so folded constants are what the program
+// would have computed
+double apply(OpCode op, double a, double b){
+    switch (op){
+    case ExpressionProgram::add: return a + b;
+    case ExpressionProgram::subtract: return a - b;
+    case ExpressionProgram::multiply: return a * b;
+    case ExpressionProgram::divide: return a / b;
+    case ExpressionProgram::negate: return -a;
+    case ExpressionProgram::sqrt: return sqrt(a);
+    case ExpressionProgram::exp: return Surface::Math::exp(a);
+    case ExpressionProgram::sin: return Surface::Math::sin(a);
+    case ExpressionProgram::cos: return Surface::Math::cos(a);
+    }
+    return 0.;
+}
+
+
+struct Node {
+    enum Kind {constant, x, z, operation};
+    Kind kind;
+    OpCode op;
+    int a, b;
+    double value;
+};
+
+
+// The expression as a graph with one node per distinct subexpression. Nodes
+// only refer to nodes created before them, so index order is an evaluation
+// order. Constant operations are folded and trivial ones (x + 0, x * 1, ...)
+// dropped as nodes are made.
+class Graph {
+public:
+    std::vector<Node> nodes;
+
+    int constant(double value){
+        return add(Node{Node::constant, ExpressionProgram::add, -1, -1, value});
+    }
+
+    int variable(Node::Kind kind){
+        return add(Node{kind, ExpressionProgram::add, -1, -1, 0.});
+    }
+
+    int operation(OpCode op, int a, int b = -1){
+        if (isUnary(op)) b = a;
+        if (isConstant(a) && isConstant(b))
+            return constant(apply(op, nodes[a].value, nodes[b].value));
+
+        /* negations are moved into a constant or the neighbouring add or
+         * subtract where that gives the same result, as derivatives make
+         * plenty of them
+         */
+        switch (op){
+        case ExpressionProgram::add:
+            if (isConstant(a, 0.)) return b;
+            if (isConstant(b, 0.)) return a;
+            if (isNegation(b)) return operation(ExpressionProgram::subtract, a, nodes[b].a);
+            if (isNegation(a)) return operation(ExpressionProgram::subtract, b, nodes[a].a);
+            if (a > b) std::swap(a, b);
+            break;
+        case ExpressionProgram::subtract:
+            if (isConstant(b, 0.)) return a;
+            if (isConstant(a, 0.)) return operation(ExpressionProgram::negate, b);
+            if (a == b) return constant(0.);
+            if (isNegation(b)) return operation(ExpressionProgram::add, a, nodes[b].a);
+            break;
+        case ExpressionProgram::multiply:
+            if (isConstant(a, 0.) || isConstant(b, 0.)) return constant(0.);
+            if (isConstant(a, 1.)) return b;
+            if (isConstant(b, 1.)) return a;
+            if (isConstant(a)) std::swap(a, b);
+            if (isNegation(a) && isNegation(b))
+                return operation(ExpressionProgram::multiply, nodes[a].a, nodes[b].a);
+            if (isNegation(a) && isConstant(b))
+                return operation(ExpressionProgram::multiply, nodes[a].a,
+                                 constant(-nodes[b].value));
+            if (a > b) std::swap(a, b);
+            break;
+        case ExpressionProgram::divide:
+            if (isConstant(a, 0.)) return constant(0.);
+            if (isConstant(b, 1.)) return a;
+            if (isNegation(a) && isConstant(b))
+                return operation(ExpressionProgram::divide, nodes[a].a,
+                                 constant(-nodes[b].value));
+            break;
+        case ExpressionProgram::negate:
+            if (isNegation(a)) return nodes[a].a;
+            break;
+        default:
+            break;
+        }
+        return add(Node{Node::operation, op, a, b, 0.});
+    }
+
+    // d node / d variable, as a node of this graph
+    int derivative(int node, Node::Kind variable){
+        auto found = derivatives.find(std::make_pair(node, int(variable)));
+        if (found != derivatives.end()) return found->second;
+
+        Node n = nodes[node];
+        int result = -1;
+        if (n.kind != Node::operation){
+            result = constant(n.kind == variable ? 1. : 0.);
+        } else{
+            int da = derivative(n.a, variable);
+            int db = isUnary(n.op) ? -1 : derivative(n.b, variable);
+            switch (n.op){
+            case ExpressionProgram::add:
+                result = operation(ExpressionProgram::add, da, db);
+                break;
+            case ExpressionProgram::subtract:
+                result = operation(ExpressionProgram::subtract, da, db);
+                break;
+            case ExpressionProgram::multiply:
+                result = operation(ExpressionProgram::add,
+                                   operation(ExpressionProgram::multiply, da, n.b),
+                                   operation(ExpressionProgram::multiply, n.a, db));
+                break;
+            case ExpressionProgram::divide:
+                if (isConstant(db, 0.)){
+                    result = operation(ExpressionProgram::divide, da, n.b);
+                    break;
+                }
+                result = operation(ExpressionProgram::divide,
+                                   operation(ExpressionProgram::subtract,
+                                             operation(ExpressionProgram::multiply, da, n.b),
+                                             operation(ExpressionProgram::multiply, n.a, db)),
+                                   operation(ExpressionProgram::multiply, n.b, n.b));
+                break;
+            case ExpressionProgram::negate:
+                result = operation(ExpressionProgram::negate, da);
+                break;
+            case ExpressionProgram::sqrt:
+                result = operation(ExpressionProgram::divide, da,
+                                   operation(ExpressionProgram::multiply, constant(2.), node));
+                break;
+            case ExpressionProgram::exp:
+                result = operation(ExpressionProgram::multiply, da, node);
+                break;
+            case ExpressionProgram::sin:
+                result = operation(ExpressionProgram::multiply, da,
+                                   operation(ExpressionProgram::cos, n.a));
+                break;
+            case ExpressionProgram::cos:
+                result = operation(ExpressionProgram::negate,
+                                   operation(ExpressionProgram::multiply, da,
+                                             operation(ExpressionProgram::sin, n.a)));
+                break;
+            }
+        }
+        derivatives[std::make_pair(node, int(variable))] = result;
+        return result;
+    }
+
+    // operations on the longest path from node down to a constant or variable
+    int height(int node) const {return heights[node];}
+    bool isConstant(int node) const {return nodes[node].kind == Node::constant;}
+    bool isNegation(int node) const {
+        return nodes[node].kind == Node::operation && nodes[node].op == ExpressionProgram::negate;
+    }
+    bool isConstant(int node, double value) const {
+        return isConstant(node) && nodes[node].value == value;
+    }
+
+private:
+    // kind, op, a, b and the bits of the value identify a node
+    std::map<std::tuple<int, int, int, int, uint64_t>, int> index;
+    std::map<std::pair<int, int>, int> derivatives;
+    std::vector<int> heights;
+
+    int add(const Node& node){
+        uint64_t bits;
+        memcpy(&bits, &node.value, sizeof(bits));
+        auto key = std::make_tuple(int(node.kind), int(node.op), node.a, node.b, bits);
+        auto found = index.find(key);
+        if (found != index.end()) return found->second;
+        nodes.push_back(node);
+        heights.push_back(node.kind != Node::operation ? 0 :
+                          1 + std::max(heights[node.a], heights[node.b]));
+        index[key] = int(nodes.size()) - 1;
+        return int(nodes.size()) - 1;
+    }
+};
+
+
+// recursive descent over the text. every method returns the node it parsed,
+// or -1 after setting error.
+class Parser {
+public:
+    Parser(const std::string& text, Graph& graph) : text(text), graph(graph) {}
+
+    int parse(std::string& error){
+        int node = expression();
+        if (node >= 0 && peek() != '\0') node = fail("expected an operator");
+        if (node >= 0 && graph.height(node) > kMaxHeight){
+            std::ostringstream out;
+            out << "too long: more than " << kMaxHeight << " operations in a chain";
+            this->error = out.str();
+            node = -1;
+        }
+        error = this->error;
+        return node;
+    }
+
+private:
+    const std::string& text;
+    Graph& graph;
+    size_t position = 0;
+    int depth = 0;
+    std::string error;
+
+    char peek(){
+        while (position < text.size() && isspace((unsigned char) text[position]))
+            position++;
+        return position < text.size() ? text[position] : '\0';
+    }
+
+    int fail(const std::string& message){
+        if (error.empty()){
+            std::ostringstream out;
+            out << message << " at column " << position + 1;
+            error = out.str();
+        }
+        return -1;
+    }
+
+    // expression = term {("+" | "-") term}
+    int expression(){
+        if (++depth > kMaxNestingDepth) return fail("too deeply nested");
+        int node = term();
+        while (node >= 0 && (peek() == '+' || peek() == '-')){
+            OpCode op = text[position++] == '+' ? ExpressionProgram::add
+                                                : ExpressionProgram::subtract;
+            int right = term();
+            node = right < 0 ? -1 : graph.operation(op, node, right);
+        }
+        depth--;
+        return node;
+    }
+
+    // term = unary {("*" | "/") unary}
+    int term(){
+        int node = unary();
+        while (node >= 0 && (peek() == '*' || peek() == '/')){
+            OpCode op = text[position++] == '*' ? ExpressionProgram::multiply
+                                                : ExpressionProgram::divide;
+            int right = unary();
+            node = right < 0 ? -1 : graph.operation(op, node, right);
+        }
+        return node;
+    }
+
+    // unary = ("-" | "+") unary | power
+    int unary(){
+        if (peek() == '-' || peek() == '+'){
+            bool negative = text[position++] == '-';
+            if (++depth > kMaxNestingDepth) return fail("too deeply nested");
+            int node = unary();
+            depth--;
+            if (node < 0 || !negative) return node;
+            return graph.operation(ExpressionProgram::negate, node);
+        }
+        return power();
+    }
+
+    // power = primary ["^" unary]
+    int power(){
+        int base = primary();
+        if (base < 0 || peek() != '^') return base;
+        position++;
+        size_t exponent_position = position;
+        // x^y^z is x^(y^z), so chained exponents nest
+        if (++depth > kMaxNestingDepth) return fail("too deeply nested");
+        int exponent = unary();
+        depth--;
+        if (exponent < 0) return -1;
+        double n = graph.nodes[exponent].value;
+        if (!graph.isConstant(exponent) || n != floor(n) || fabs(n) > kMaxExponent){
+            position = exponent_position;
+            return fail("exponents must be whole numbers up to 64");
+        }
+        return integerPower(base, int(n));
+    }
+
+    int integerPower(int base, int n){
+        /* by squaring, so x^8 takes three multiplications */
+        if (n < 0)
+            return graph.operation(ExpressionProgram::divide, graph.constant(1.),
+                                   integerPower(base, -n));
+        int result = graph.constant(1.);
+        for (int square = base; n > 0; n >>= 1){
+            if (n & 1) result = graph.operation(ExpressionProgram::multiply, result, square);
+            if (n > 1) square = graph.operation(ExpressionProgram::multiply, square, square);
+        }
+        return result;
+    }
+
+    // primary = number | "x" | "z" | "pi" | "e" | function "(" expression ")"
+    //         | "(" expression ")"
+    int primary(){
+        char c = peek();
+        if (isdigit((unsigned char) c) || c == '.') return number();
+        if (c == '(') return parenthesized();
+        if (!isalpha((unsigned char) c)) return fail(c == '\0' ? "unexpected end"
+                                                                : "unexpected character");
+
+        size_t begin = position;
+        while (position < text.size() && isalnum((unsigned char) text[position]))
+            position++;
+        std::string name = text.substr(begin, position - begin);
+        if (name == "x") return graph.variable(Node::x);
+        if (name == "z") return graph.variable(Node::z);
+        if (name == "pi") return graph.constant(M_PI);
+        if (name == "e") return graph.constant(M_E);
+
+        OpCode op;
+        if (name == "sqrt") op = ExpressionProgram::sqrt;
+        else if (name == "exp") op = ExpressionProgram::exp;
+        else if (name == "sin") op = ExpressionProgram::sin;
+        else if (name == "cos") op = ExpressionProgram::cos;
+        else{
+            position = begin;
+            return fail("unknown name '" + name + "'");
+        }
+        if (peek() != '(') return fail("expected '(' after " + name);
+        int argument = parenthesized();
+        return argument < 0 ? -1 : graph.operation(op, argument);
+    }
+
+    int parenthesized(){
+        position++; // '('
+        int node = expression();
+        if (node < 0) return -1;
+        if (peek() != ')') return fail("expected ')'");
+        position++;
+        return node;
+    }
+
+    int number(){
+        /* digits [. digits] [e [+-] digits], read in the C locale whatever
+         * the app's is
+         */
+        size_t begin = position;
+        while (position < text.size() && isdigit((unsigned char) text[position])) position++;
+        if (position < text.size() && text[position] == '.'){
+            position++;
+            while (position < text.size() && isdigit((unsigned char) text[position])) position++;
+        }
+        if (position < text.size() && (text[position] == 'e' || text[position] == 'E')){
+            size_t exponent = position + 1;
+            if (exponent < text.size() && (text[exponent] == '+' || text[exponent] == '-'))
+                exponent++;
+            if (exponent < text.size() && isdigit((unsigned char) text[exponent])){
+                position = exponent;
+                while (position < text.size() && isdigit((unsigned char) text[position]))
+                    position++;
+            }
+        }
+        std::istringstream in(text.substr(begin, position - begin));
+        in.imbue(std::locale::classic());
+        double value;
+        if (!(in >> value)){
+            position = begin;
+            return fail("malformed number");
+        }
+        return graph.constant(value);
+    }
+};
+
+
+ExpressionProgram compileProgram(const Graph& graph, const std::vector<int>& outputs){
+    /* one instruction per operation node the outputs depend on, in index
+     * order. a temporary register is reused once the last instruction that
+     * reads it has run, which keeps the registers of a block in L1.
+     */
+    const std::vector<Node>& nodes = graph.nodes;
+    const int n = int(nodes.size());
+    std::vector<bool> needed(n, false);
+    for (int output : outputs) needed[output] = true;
+    for (int i = n - 1; i >= 0; i--){
+        if (!needed[i] || nodes[i].kind != Node::operation) continue;
+        needed[nodes[i].a] = needed[nodes[i].b] = true;
+    }
+    std::vector<int> last_use(n, -1);
+    for (int i = 0; i < n; i++){
+        if (!needed[i] || nodes[i].kind != Node::operation) continue;
+        last_use[nodes[i].a] = last_use[nodes[i].b] = i;
+    }
+    for (int output : outputs) last_use[output] = INT_MAX;
+
+    ExpressionProgram program;
+    std::vector<int> reg(n, -1);
+    std::vector<int> free_registers;
+    for (int i = 0; i < n; i++){
+        if (!needed[i]) continue;
+        const Node& node = nodes[i];
+        switch (node.kind){
+        case Node::x: reg[i] = 0; break;
+        case Node::z: reg[i] = 1; break;
+        case Node::constant:
+            reg[i] = program.num_registers++;
+            program.constants.push_back(ExpressionProgram::Constant{reg[i], node.value});
+            break;
+        case Node::operation:
+            for (int operand : {node.a, node.b}){
+                if (last_use[operand] == i && nodes[operand].kind == Node::operation){
+                    free_registers.push_back(reg[operand]);
+                    last_use[operand] = -1; // a == b: free once
+                }
+            }
+            if (free_registers.empty()){
+                reg[i] = program.num_registers++;
+            } else{
+                reg[i] = free_registers.back();
+                free_registers.pop_back();
+            }
+            program.instructions.push_back(
+                        ExpressionProgram::Instruction{node.op, reg[i], reg[node.a], reg[node.b]});
+            break;
+        }
+    }
+    for (int output : outputs) program.outputs.push_back(reg[output]);
+    program.point_registers.assign(program.num_registers, 0.);
+    for (const ExpressionProgram::Constant& constant : program.constants)
+        program.point_registers[constant.reg] = constant.value;
+    return program;
+}
+}
+
+
+std::shared_ptr<const Expression> Expression::compile(const std::string& text,
+                                                      std::string& error){
+    Graph graph;
+    Parser parser(text, graph);
+    int f = parser.parse(error);
+    if (f < 0) return nullptr;
+    int df_dx = graph.derivative(f, Node::x);
+    int df_dz = graph.derivative(f, Node::z);
+
+    std::shared_ptr<Expression> expression(new Expression);
+    expression->m_text = text;
+    expression->value_program = compileProgram(graph, {f});
+    expression->gradient_program = compileProgram(graph, {f, df_dx, df_dz});
+    return expression;
+}
+
+
+namespace Surface{
+namespace {
+std::shared_ptr<const Expression>& customSlot(){
+    static std::shared_ptr<const Expression> slot = [](){
+        std::string error;
+        return Expression::compile(kDefaultExpression, error);
+    }();
+    return slot;
+}
+}
+
+
+const std::shared_ptr<const Expression>& customExpression(){
+    return customSlot();
+}
+
+
+void setCustomExpression(std::shared_ptr<const Expression> expression){
+    customSlot() = std::move(expression);
+}
+}
@@ -1,12 +1,34 @@
 #include "gradient_descent.h"
+#include "surface_kernels.h"
 
 #include <math.h>
 
-const double kDivisionEpsilon = 1e-12;
-const double kFiniteDiffEpsilon = 1e-12;
-const double kConvergenceEpsilon = 1e-2;
+namespace Optimizer{
+namespace {
+const char* const kNames[kNumOptimizers] = {
+    "vanilla", "momentum", "qhm", "ada_grad", "rms_prop", "adam", "qhadam"};
+}
+
+
+const char* name(OptimizerName optimizer_name){
+    return kNames[optimizer_name];
+}
+
+
+bool fromName(const std::string& name, OptimizerName& optimizer_name){
+    for (int i = 0; i < kNumOptimizers; i++){
+        if (name == kNames[i]){
+            optimizer_name = OptimizerName(i);
+            return true;
+        }
+    }
+    return false;
+}
+}
+
 
 Function::FunctionName GradientDescent::function_name = Function::local_minimum;
+Gradient::GradientMethod GradientDescent::gradient_method = Gradient::analytic;
 
 
 GradientDescent::GradientDescent()
@@ -17,53 +39,104 @@ GradientDescent::GradientDescent()
 }
 
 
-double GradientDescent::f(double x, double z){
-    switch (function_name){
-    case Function::local_minimum:{
-        z *= 1.4;
-        return -2 * exp(-((x - 1) * (x - 1) + z * z) / .2) -
-                6. * exp(-((x + 1) * (x + 1) + z * z) / .2) +
-                x * x + z * z;
-    }
-    case Function::global_minimum:{
-        return x * x + z * z;
-    }
-    case Function::saddle_point:{
-        return sin(x) + z * z;
-    }
-    case Function::ecliptic_bowl:{
-        x /= 2.;
-        z /= 2.;
-        return -exp(-(x * x + 5 * z * z)) + x * x + 0.5 * z * z;
-    }
-    case Function::hills:{
-        z *= 1.4;
-        return  2 * exp(-((x - 1) * (x - 1) + z * z) / .2) +
-                6. * exp(-((x + 1) * (x + 1) + z * z) / .2) -
-                2 * exp(-((x - 1) * (x  - 1) + (z + 1) * (z + 1)) / .2) +
-                x * x + z * z;
-    }
-    case Function::plateau:{
-        x *= 10;
-        z *= 10;
-        double r = sqrt(z * z + x * x) + 0.01;
-        return -sin(r) / r + 0.01 * r * r;
-    }
+GradientDescent::~GradientDescent(){
+    delete pending_snapshot.load();
+}
+
+
+std::unique_ptr<GradientDescent> GradientDescent::create(Optimizer::OptimizerName optimizer_name){
+    GradientDescent* descent = nullptr;
+    switch (optimizer_name){
+    case Optimizer::vanilla: descent = new VanillaGradientDescent; break;
+    case Optimizer::momentum: descent = new Momentum; break;
+    case Optimizer::qhm: descent = new QHM; break;
+    case Optimizer::ada_grad: descent = new AdaGrad; break;
+    case Optimizer::rms_prop: descent = new RMSProp; break;
+    case Optimizer::adam: descent = new Adam; break;
+    case Optimizer::qhadam: descent = new QHAdam; break;
     }
-    return 0.;
+    return std::unique_ptr<GradientDescent>(descent);
+}
+
+
+void GradientDescent::f(const double* xs, const double* zs, double* out, size_t n){
+    SurfaceKernels::evaluate(function_name, xs, zs, out, n);
+}
+
+
+void GradientDescent::gradient(const double* xs, const double* zs,
+                               double* grad_x, double* grad_z, size_t n){
+    SurfaceKernels::gradient(function_name, gradient_method, xs, zs, grad_x, grad_z, n);
+}
+
+
+double GradientDescent::f(double x, double z){
+    double value;
+    f(&x, &z, &value, 1);
+    return value;
+}
+
+
+double GradientDescent::valueAndGradient(double x, double z, Point& grad){
+    double value;
+    SurfaceKernels::valueAndGradient(function_name, &x, &z, &value, &grad.x, &grad.z, 1);
+    return value;
+}
+
+
+Point GradientDescent::gradient(double x, double z){
+    Point grad;
+    gradient(&x, &z, &grad.x, &grad.z, 1);
+    return grad;
 }
 
 
 void GradientDescent::computeGradient(){
-    // use finite difference method
-    grad.x = (f(p.x + kFiniteDiffEpsilon, p.z) -
-            f(p.x - kFiniteDiffEpsilon, p.z)) / (2 * kFiniteDiffEpsilon);
+    grad = gradient(p.x, p.z);
+}
 
-    grad.z = (f(p.x, p.z + kFiniteDiffEpsilon) -
-            f(p.x, p.z - kFiniteDiffEpsilon)) / (2 * kFiniteDiffEpsilon);
+
+Hyperparameters GradientDescent::hyperparameters(){
+    Hyperparameters params;
+    params.learning_rate = learning_rate;
+    return params;
+}
+
+
+void GradientDescent::setHyperparameters(const Hyperparameters& params){
+    learning_rate = params.learning_rate;
+}
+
+
+void GradientDescent::publishHyperparameters(const Hyperparameters& params){
+    published = params;
+    Snapshot* snapshot = new Snapshot{params, ++published_version};
+    /* if the descent hasn't taken the previous snapshot yet, it never will:
+     * the exchange hands it back to us
+     */
+    delete pending_snapshot.exchange(snapshot, std::memory_order_acq_rel);
+}
+
+
+Hyperparameters GradientDescent::publishedHyperparameters(){
+    /* until the first publish the fields are only read on either side */
+    if (published_version == 0) return hyperparameters();
+    return published;
+}
+
+
+void GradientDescent::applyPublishedHyperparameters(){
+    /* a plain load first, so a step without news costs no read-modify-write */
+    if (pending_snapshot.load(std::memory_order_acquire) == nullptr) return;
+    Snapshot* snapshot = pending_snapshot.exchange(nullptr, std::memory_order_acq_rel);
+    if (snapshot == nullptr) return;
+    setHyperparameters(snapshot->params);
+    applied_version = snapshot->version;
+    delete snapshot;
 }
 
 void GradientDescent::resetPositionAndComputeGradient(){
+    applyPublishedHyperparameters();
     is_converged = false;
     m_delta = Point(0, 0);
     resetState();
@@ -85,8 +158,15 @@ Point GradientDescent::takeGradientStep(){
      * - update delta to the step just taken
      * - update position to new position.
      * - update grad to gradient of the new position
+     * - take newly published hyperparameters into use first
      */
 
+    applyPublishedHyperparameters();
+    return replayGradientStep();
+}
+
+
+Point GradientDescent::replayGradientStep(){
     if (abs(gradX()) < kConvergenceEpsilon &&
          abs(gradZ()) < kConvergenceEpsilon){
          is_converged = true;
@@ -98,11 +178,47 @@ Point GradientDescent::takeGradientStep(){
     return p;
 }
 
+
+DescentState GradientDescent::saveState(){
+    DescentState state;
+    state.hyperparameters = hyperparameters();
+    state.position = p;
+    state.delta = m_delta;
+    state.gradient = grad;
+    state.converged = is_converged;
+    saveMoments(state);
+    return state;
+}
+
+
+void GradientDescent::restoreState(const DescentState& state){
+    setHyperparameters(state.hyperparameters);
+    p = state.position;
+    m_delta = state.delta;
+    grad = state.gradient;
+    is_converged = state.converged;
+    restoreMoments(state);
+}
+
+
 void VanillaGradientDescent::updateGradientDelta(){
     m_delta.x = -learning_rate * grad.x;
     m_delta.z = -learning_rate * grad.z;
 }
 
+Hyperparameters Momentum::hyperparameters(){
+    Hyperparameters params = GradientDescent::hyperparameters();
+    params.decay_rate = decay_rate;
+    return params;
+}
+
+
+void Momentum::setHyperparameters(const Hyperparameters& params){
+    GradientDescent::setHyperparameters(params);
+    decay_rate = params.decay_rate;
+}
+
+
 void Momentum::updateGradientDelta(){
     /* https://en.wikipedia.org/wiki/Stochastic_gradient_descent#Momentum */
 
@@ -110,12 +226,27 @@ void Momentum::updateGradientDelta(){
     m_delta.z = decay_rate * m_delta.z - learning_rate * grad.z;
 }
 
+Hyperparameters QHM::hyperparameters()
+{
+    Hyperparameters params = GradientDescent::hyperparameters();
+    params.decay_rate = decay_rate;
+    params.discount_factor = discount_factor;
+    return params;
+}
+
+void QHM::setHyperparameters( const Hyperparameters &params )
+{
+    GradientDescent::setHyperparameters( params );
+    decay_rate = params.decay_rate;
+    discount_factor = params.discount_factor;
+}
+
 void QHM::updateGradientDelta()
 {
     /* https://arxiv.org/abs/1810.06801v4 - paper on QHM and QHADAM */
 
-    momentum.x = decay_rate * momentum.x + ( 1 - decay_rate ) * grad.x;
-    momentum.z = decay_rate * momentum.z + (1 - decay_rate) * grad.z;
+    m_momentum.x = decay_rate * m_momentum.x + ( 1 - decay_rate ) * grad.x;
+    m_momentum.z = decay_rate * m_momentum.z + (1 - decay_rate) * grad.z;
 
     // we need to denormalize the learning rate by 1/(1-decay_rate) to correct
     // for the fact that the momentum term is scaled by decay_rate here, but not
@@ -123,21 +254,31 @@ void QHM::updateGradientDelta()
     auto adjusted_learning_rate = learning_rate / ( 1 - decay_rate );
 
     m_delta.x = -adjusted_learning_rate
-            * ( ( 1 - discount_factor ) * grad.x + discount_factor * momentum.x );
+            * ( ( 1 - discount_factor ) * grad.x + discount_factor * m_momentum.x );
     m_delta.z = -adjusted_learning_rate
-            * ( ( 1 - discount_factor ) * grad.z + discount_factor * momentum.z );
+            * ( ( 1 - discount_factor ) * grad.z + discount_factor * m_momentum.z );
 }
 
 void QHM::resetState()
 {
-    momentum = Point( 0, 0 );
+    m_momentum = Point( 0, 0 );
+}
+
+void QHM::saveMoments( DescentState &state )
+{
+    state.first_moment = m_momentum;
+}
+
+void QHM::restoreMoments( const DescentState &state )
+{
+    m_momentum = state.first_moment;
 }
 
 void AdaGrad::updateGradientDelta(){
     /* https://en.wikipedia.org/wiki/Stochastic_gradient_descent#AdaGrad */
 
-    grad_sum_of_squared.x += pow(grad.x, 2);
-    grad_sum_of_squared.z += pow(grad.z, 2);
+    grad_sum_of_squared.x += grad.x * grad.x;
+    grad_sum_of_squared.z += grad.z * grad.z;
     m_delta.x = -learning_rate * grad.x / (sqrt(grad_sum_of_squared.x) + kDivisionEpsilon);
     m_delta.z = -learning_rate * grad.z / (sqrt(grad_sum_of_squared.z) + kDivisionEpsilon);
 }
@@ -148,13 +289,36 @@ void AdaGrad::resetState(){
 }
 
 
+void AdaGrad::saveMoments(DescentState& state){
+    state.second_moment = grad_sum_of_squared;
+}
+
+
+void AdaGrad::restoreMoments(const DescentState& state){
+    grad_sum_of_squared = state.second_moment;
+}
+
+
+Hyperparameters RMSProp::hyperparameters(){
+    Hyperparameters params = GradientDescent::hyperparameters();
+    params.decay_rate = decay_rate;
+    return params;
+}
+
+
+void RMSProp::setHyperparameters(const Hyperparameters& params){
+    GradientDescent::setHyperparameters(params);
+    decay_rate = params.decay_rate;
+}
+
+
 void RMSProp::updateGradientDelta(){
     /* https://en.wikipedia.org/wiki/Stochastic_gradient_descent#RMSProp */
 
     decayed_grad_sum_of_squared.x *= decay_rate;
-    decayed_grad_sum_of_squared.x += (1 - decay_rate) * pow(grad.x, 2);
+    decayed_grad_sum_of_squared.x += (1 - decay_rate) * (grad.x * grad.x);
     decayed_grad_sum_of_squared.z *= decay_rate;
-    decayed_grad_sum_of_squared.z += (1 - decay_rate) * pow(grad.z, 2);
+    decayed_grad_sum_of_squared.z += (1 - decay_rate) * (grad.z * grad.z);
     m_delta.x = -learning_rate * grad.x / (sqrt(decayed_grad_sum_of_squared.x) + kDivisionEpsilon);
     m_delta.z = -learning_rate * grad.z / (sqrt(decayed_grad_sum_of_squared.z) + kDivisionEpsilon);
 }
@@ -164,6 +328,33 @@ void RMSProp::resetState(){
     decayed_grad_sum_of_squared = Point(0, 0);
 }
 
+
+void RMSProp::saveMoments(DescentState& state){
+    state.second_moment = decayed_grad_sum_of_squared;
+}
+
+
+void RMSProp::restoreMoments(const DescentState& state){
+    decayed_grad_sum_of_squared = state.second_moment;
+}
+
+Hyperparameters Adam::hyperparameters()
+{
+    Hyperparameters params = GradientDescent::hyperparameters();
+    params.beta1 = beta1;
+    params.beta2 = beta2;
+    params.use_bias_correction = use_bias_correction;
+    return params;
+}
+
+void Adam::setHyperparameters( const Hyperparameters &params )
+{
+    GradientDescent::setHyperparameters( params );
+    beta1 = params.beta1;
+    beta2 = params.beta2;
+    use_bias_correction = params.use_bias_correction;
+}
+
 void Adam::baseCompute( Point &scaled_decayed_grad_sum, Point &scaled_decayed_grad_sum_sq )
 {
     // first moment (momentum)
@@ -174,9 +365,9 @@ void Adam::baseCompute( Point &scaled_decayed_grad_sum, Point &scaled_decayed_gr
 
     // second moment (rmsprop)
     decayed_grad_sum_of_squared.x *= beta2;
-    decayed_grad_sum_of_squared.x += (1 - beta2) * pow(grad.x, 2);
+    decayed_grad_sum_of_squared.x += (1 - beta2) * (grad.x * grad.x);
     decayed_grad_sum_of_squared.z *= beta2;
-    decayed_grad_sum_of_squared.z += (1 - beta2) * pow(grad.z, 2);
+    decayed_grad_sum_of_squared.z += (1 - beta2) * (grad.z * grad.z);
 
     if (use_bias_correction) {
         scaled_decayed_grad_sum.x = decayed_grad_sum.x / ( 1 - beta1_pow );
@@ -214,6 +405,37 @@ void Adam::resetState(){
     beta2_pow = beta2;
 }
 
+void Adam::saveMoments( DescentState &state )
+{
+    state.first_moment = decayed_grad_sum;
+    state.second_moment = decayed_grad_sum_of_squared;
+    state.beta1_pow = beta1_pow;
+    state.beta2_pow = beta2_pow;
+}
+
+void Adam::restoreMoments( const DescentState &state )
+{
+    decayed_grad_sum = state.first_moment;
+    decayed_grad_sum_of_squared = state.second_moment;
+    beta1_pow = state.beta1_pow;
+    beta2_pow = state.beta2_pow;
+}
+
+Hyperparameters QHAdam::hyperparameters()
+{
+    Hyperparameters params = Adam::hyperparameters();
+    params.discount_factor = discount_factor;
+    params.squared_discount_factor = squared_discount_factor;
+    return params;
+}
+
+void QHAdam::setHyperparameters( const Hyperparameters &params )
+{
+    Adam::setHyperparameters( params );
+    discount_factor = params.discount_factor;
+    squared_discount_factor = params.squared_discount_factor;
+}
+
 void QHAdam::updateGradientDelta()
 {
     /* https://arxiv.org/abs/1810.06801v4 - paper on QHM and QHADAM */
@@ -222,12 +444,12 @@ void QHAdam::updateGradientDelta()
 
     m_delta.x = -learning_rate
             * ( ( 1 - discount_factor ) * grad.x + discount_factor * grad_sum.x )
-            / ( sqrt( ( 1 - squared_discount_factor ) * pow( grad.x, 2 )
+            / ( sqrt( ( 1 - squared_discount_factor ) * ( grad.x * grad.x )
                       + squared_discount_factor * grad_sum_sq.x )
                 + kDivisionEpsilon );
     m_delta.z = -learning_rate
             * ( ( 1 - discount_factor ) * grad.z + discount_factor * grad_sum.z )
-            / ( sqrt( ( 1 - squared_discount_factor ) * pow( grad.z, 2 )
+            / ( sqrt( ( 1 - squared_discount_factor ) * ( grad.z * grad.z )
                       + squared_discount_factor * grad_sum_sq.z )
                 + kDivisionEpsilon );
 }
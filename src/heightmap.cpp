@@ -0,0 +1,95 @@
+#include "heightmap.h"
+
+#include <math.h>
+
+#include <atomic>
+#include <sstream>
+
+namespace {
+std::atomic<uint64_t> next_id{1};
+}
+
+
+Heightmap::Heightmap(const std::string& name) : m_name(name), m_id(next_id++) {}
+
+
+void Heightmap::setGrid(const float* values, size_t width, size_t height){
+    m_values = values;
+    m_width = width;
+    m_height = height;
+    cells_per_x = double(width - 1) / (kHeightmapMax - kHeightmapMin);
+    cells_per_z = double(height - 1) / (kHeightmapMax - kHeightmapMin);
+}
+
+
+std::shared_ptr<const Heightmap> Heightmap::openRaw(const std::string& path, size_t width,
+                                                    std::string& error){
+    std::shared_ptr<Heightmap> heightmap(new Heightmap(path));
+    MappedFile& file = heightmap->file;
+    if (!file.open(path, MappedFile::random)){
+        error = "can't open " + path;
+        return nullptr;
+    }
+    if (file.size() % sizeof(float) != 0){
+        error = path + " is not a grid of float32 values";
+        return nullptr;
+    }
+    size_t count = file.size() / sizeof(float);
+    std::ostringstream out;
+    if (count > kMaxHeightmapSamples){
+        out << path << " holds " << count << " values; at most "
+            << kMaxHeightmapSamples << " are supported";
+        error = out.str();
+        return nullptr;
+    }
+    if (width == 0){
+        width = size_t(sqrt(double(count)) + 0.5);
+        if (width * width != count){
+            out << path << " holds " << count << " values, which isn't a square grid; "
+                << "give its width";
+            error = out.str();
+            return nullptr;
+        }
+    }
+    if (width < 2 || count % width != 0 || count / width < 2){
+        out << path << " holds " << count << " values, which isn't a grid of width "
+            << width << " (at least 2 x 2)";
+        error = out.str();
+        return nullptr;
+    }
+
+    /* the mapping is page aligned, so fine for floats */
+    heightmap->setGrid(reinterpret_cast<const float*>(file.data()), width, count / width);
+    return heightmap;
+}
+
+
+std::shared_ptr<const Heightmap> Heightmap::fromValues(std::vector<float> values,
+                                                       size_t width, size_t height,
+                                                       const std::string& name){
+    std::shared_ptr<Heightmap> heightmap(new Heightmap(name));
+    heightmap->owned_values = std::move(values);
+    heightmap->setGrid(heightmap->owned_values.data(), width, height);
+    return heightmap;
+}
+
+
+namespace Surface{
+namespace {
+std::shared_ptr<const Heightmap>& heightmapSlot(){
+    static std::shared_ptr<const Heightmap> slot =
+            Heightmap::fromValues(std::vector<float>(4, 0.f), 2, 2, "flat");
+    return slot;
+}
+}
+
+
+const std::shared_ptr<const Heightmap>& heightmap(){
+    return heightmapSlot();
+}
+
+
+void setHeightmap(std::shared_ptr<const Heightmap> heightmap){
+    heightmapSlot() = std::move(heightmap);
+}
+}
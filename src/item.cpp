@@ -1,11 +1,176 @@
 #include <math.h>
+#include <algorithm>
+
+#include <QtCore/QHash>
+#include <QtCore/QTimer>
 
 #include "item.h"
 
+namespace {
+// resources shared by every item. the graph's renderer parses a mesh file
+// once and keys it by name, so all items use the same few names; a texture
+// image is made once per color and, QImage being implicitly shared, every
+// item of that color references the same pixels.
+const QString kBallMesh = QStringLiteral(":/mesh/largesphere.obj");
+const QString kArrowMesh = QStringLiteral(":/mesh/narrowarrow.obj");
+const QString kSquareMesh = QStringLiteral(":/mesh/plane.obj");
+
+const QImage& colorTexture(QColor color){
+    static QHash<QRgb, QImage> textures;
+    QImage& texture = textures[color.rgba()];
+    if (texture.isNull()){
+        texture = QImage(2, 2, QImage::Format_ARGB32);
+        texture.fill(color);
+    }
+    return texture;
+}
+}
+
+
+PlotTransform::PlotTransform(Q3DSurface* graph) : QObject(graph), m_graph(graph){
+    QObject::connect(graph, &Q3DSurface::axisXChanged, this, [this](){connectAxes();});
+    QObject::connect(graph, &Q3DSurface::axisYChanged, this, [this](){connectAxes();});
+    QObject::connect(graph, &Q3DSurface::axisZChanged, this, [this](){connectAxes();});
+    connectAxes();
+}
+
+
+PlotTransform* PlotTransform::forGraph(Q3DSurface* graph){
+    PlotTransform* transform = graph->findChild<PlotTransform*>(QString(), Qt::FindDirectChildrenOnly);
+    if (transform == nullptr) transform = new PlotTransform(graph);
+    return transform;
+}
+
+
+void PlotTransform::connectAxes(){
+    for (auto& connection : axis_connections)
+        QObject::disconnect(connection);
+    axis_connections.clear();
+    for (QAbstract3DAxis* axis : {static_cast<QAbstract3DAxis*>(m_graph->axisX()),
+                                  static_cast<QAbstract3DAxis*>(m_graph->axisY()),
+                                  static_cast<QAbstract3DAxis*>(m_graph->axisZ())}){
+        if (axis != nullptr)
+            axis_connections.push_back(QObject::connect(
+                    axis, &QAbstract3DAxis::rangeChanged, this, [this](){update();}));
+    }
+    update();
+}
+
+
+void PlotTransform::update(){
+    min_x = m_graph->axisX()->min();
+    max_x = m_graph->axisX()->max();
+    min_y = m_graph->axisY()->min();
+    max_y = m_graph->axisY()->max();
+    min_z = m_graph->axisZ()->min();
+    max_z = m_graph->axisZ()->max();
+    scaling_vector = QVector3D(max_x - min_x, 0, max_z - min_z);
+}
+
+
+SceneUpdater::SceneUpdater(Q3DSurface* graph) : QObject(graph){}
+
+
+SceneUpdater* SceneUpdater::forGraph(Q3DSurface* graph){
+    SceneUpdater* updater = graph->findChild<SceneUpdater*>(QString(), Qt::FindDirectChildrenOnly);
+    if (updater == nullptr) updater = new SceneUpdater(graph);
+    return updater;
+}
+
+
+void SceneUpdater::markDirty(Item* item){
+    dirty_items.push_back(item);
+    if (flush_scheduled) return;
+    flush_scheduled = true;
+    QTimer::singleShot(0, this, [this](){flush();});
+}
+
+
+void SceneUpdater::forget(Item* item){
+    dirty_items.erase(std::remove(dirty_items.begin(), dirty_items.end(), item),
+                      dirty_items.end());
+}
+
+
+void SceneUpdater::flush(){
+    flush_scheduled = false;
+    std::vector<Item*> items;
+    items.swap(dirty_items);
+    for (Item* item : items)
+        item->commit();
+}
+
+
+Item::~Item(){
+    if (dirty) updater->forget(this);
+    m_graph->releaseCustomItem(this);
+}
+
+
+void Item::setPosition(const QVector3D& position){
+    staged_position = position;
+    position_staged = true;
+    stage();
+}
+
+
+void Item::setScaling(const QVector3D& scaling){
+    staged_scaling = scaling;
+    scaling_staged = true;
+    stage();
+}
+
+
+void Item::setRotation(const QQuaternion& rotation){
+    staged_rotation = rotation;
+    rotation_staged = true;
+    stage();
+}
+
+
+QVector3D Item::position() const{
+    return position_staged ? staged_position : QCustom3DItem::position();
+}
+
+
+QVector3D Item::scaling() const{
+    return scaling_staged ? staged_scaling : QCustom3DItem::scaling();
+}
+
+
+QQuaternion Item::rotation() const{
+    return rotation_staged ? staged_rotation : QCustom3DItem::rotation();
+}
+
+
+void Item::stage(){
+    // not in a graph yet: nothing is drawn, so there is nothing to coalesce
+    if (m_graph == nullptr){
+        commit();
+        return;
+    }
+    if (dirty) return;
+    dirty = true;
+    if (updater == nullptr) updater = SceneUpdater::forGraph(m_graph);
+    updater->markDirty(this);
+}
+
+
+void Item::commit(){
+    if (position_staged && staged_position != QCustom3DItem::position())
+        QCustom3DItem::setPosition(staged_position);
+    if (scaling_staged && staged_scaling != QCustom3DItem::scaling())
+        QCustom3DItem::setScaling(staged_scaling);
+    if (rotation_staged && staged_rotation != QCustom3DItem::rotation())
+        QCustom3DItem::setRotation(staged_rotation);
+    position_staged = scaling_staged = rotation_staged = false;
+    dirty = false;
+}
+
+
 void Item::setColor(QColor color){
-    QImage pointColor = QImage(2, 2, QImage::Format_ARGB32);
-    pointColor.fill(color);
-    setTextureImage(pointColor);
+    m_color = color;
+    setTextureImage(colorTexture(color));
 }
 
 
@@ -17,30 +182,36 @@ void Item::addToGraph(Q3DSurface *graph){
 }
 
 
+PlotTransform* Item::plotTransform(){
+    if (transform == nullptr) transform = PlotTransform::forGraph(m_graph);
+    return transform;
+}
+
+
 QVector3D Item::plotScalingVector(){
-    return QVector3D(m_graph->axisX()->max() - m_graph->axisX()->min(), 0,
-                     m_graph->axisZ()->max() - m_graph->axisZ()->min());
+    return plotTransform()->scalingVector();
 }
 
 
-Ball::Ball(Q3DSurface* graph, QColor color, double (*_f) (double, double))
+Ball::Ball(Q3DSurface* graph, QColor color, Surface::BatchFunction _f)
     : f(_f)
 {
     setScaling(QVector3D(0.01f, 0.01f, 0.01f));
-    setMeshFile(QStringLiteral(":/mesh/largesphere.obj"));
+    setMeshFile(kBallMesh);
     setColor(color);
     addToGraph(graph);
 }
 
 
 void Ball::setPositionOnSurface(Point p){
-    float yOffset =  (m_graph->axisY()->max() - m_graph->axisY()->min()) /
-            kBallRadiusPerGraph;
-    setPosition(QVector3D(p.x, f(p.x, p.z) + yOffset, p.z));
+    float yOffset = plotTransform()->yRange() / kBallRadiusPerGraph;
+    double y;
+    f(&p.x, &p.z, &y, 1);
+    setPosition(QVector3D(p.x, y + yOffset, p.z));
 }
 
 Arrow::Arrow(Q3DSurface* graph) : Item(graph){
-    setMeshFile(QStringLiteral(":/mesh/narrowarrow.obj"));
+    setMeshFile(kArrowMesh);
     setMagnitude(0);
     setColor(Qt::black);
 }
@@ -53,7 +224,7 @@ Arrow::Arrow(Q3DSurface* graph, QVector3D vector): Arrow(graph) {
 
 Arrow::Arrow(Q3DSurface* graph, QVector3D vector, QColor color) {
     m_graph = graph;
-    setMeshFile(QStringLiteral(":/mesh/narrowarrow.obj"));
+    setMeshFile(kArrowMesh);
     setMagnitude(0);
     setColor(color);
     setVector(vector);
@@ -89,7 +260,7 @@ void Arrow::setMagnitude(const float &magnitude){
 
 
 Square::Square(Q3DSurface* graph) : Item(){
-    setMeshFile(QStringLiteral(":/mesh/plane.obj"));
+    setMeshFile(kSquareMesh);
     setScaling(QVector3D(0.1, 0.1, 0.1));
     QColor color = Qt::white;
     color.setAlpha(150);
@@ -99,14 +270,21 @@ Square::Square(Q3DSurface* graph) : Item(){
 
 
 Square::Square(Q3DSurface* graph, QString direction) : Square(graph){
+    m_is_x_direction = (direction == "x");
+    reset();
+}
+
+
+void Square::reset(){
     QQuaternion z_rotation = QQuaternion::fromAxisAndAngle(0, 0, 1, 90);
-    if (direction == "x"){  
+    if (m_is_x_direction){
         QQuaternion x_rotation = QQuaternion::fromAxisAndAngle(1, 0, 0, -90);
         setRotation(z_rotation * x_rotation);
     } else{
         setRotation(z_rotation);
     }
-    m_is_x_direction = (direction == "x");
+    m_is_positive = false;
+    setScaling(QVector3D(0.1, 0.1, 0.1));
 }
 
 
@@ -148,31 +326,173 @@ void Square::flipDirection(){
 }
 
 
-int Line::layer = 1;
+ItemPool::ItemPool(Q3DSurface* graph) : QObject(graph), m_graph(graph){}
 
 
-Line::Line(Q3DSurface* graph, QColor color, double (*_f) (double, double))
-    : m_graph(graph), f(_f)
-{
-    line_proxy = new QSurfaceDataProxy;
-    setDataProxy(line_proxy);
+ItemPool* ItemPool::forGraph(Q3DSurface* graph){
+    ItemPool* pool = graph->findChild<ItemPool*>(QString(), Qt::FindDirectChildrenOnly);
+    if (pool == nullptr) pool = new ItemPool(graph);
+    return pool;
+}
+
+
+ItemPool::Handle<Arrow> ItemPool::arrow(QVector3D vector, QColor color){
+    std::vector<Arrow*>& free = free_arrows[color.rgba()];
+    Arrow* arrow;
+    if (free.empty()){
+        arrow = new Arrow(m_graph, vector, color);
+    } else{
+        arrow = free.back();
+        free.pop_back();
+        arrow->setVector(vector);
+        arrow->setVisible(true);
+    }
+    return Handle<Arrow>(arrow, Recycler<Arrow>(this));
+}
+
+
+ItemPool::Handle<Arrow> ItemPool::arrow(){
+    Handle<Arrow> arrow = this->arrow(QVector3D(0, 1, 0), Qt::black);
+    arrow->setMagnitude(0);
+    return arrow;
+}
+
+
+ItemPool::Handle<Square> ItemPool::square(QString direction){
+    std::vector<Square*>& free = direction == "x" ? free_x_squares : free_z_squares;
+    Square* square;
+    if (free.empty()){
+        square = new Square(m_graph, direction);
+    } else{
+        square = free.back();
+        free.pop_back();
+        square->reset();
+        square->setVisible(true);
+    }
+    return Handle<Square>(square, Recycler<Square>(this));
+}
+
+
+ItemPool::Handle<Ball> ItemPool::ball(QColor color, Surface::BatchFunction f){
+    std::vector<Ball*>& free = free_balls[color.rgba()];
+    Ball* ball;
+    if (free.empty()){
+        ball = new Ball(m_graph, color, f);
+    } else{
+        ball = free.back();
+        free.pop_back();
+        ball->f = f;
+        ball->setVisible(true);
+    }
+    return Handle<Ball>(ball, Recycler<Ball>(this));
+}
+
+
+void ItemPool::recycle(Arrow* arrow){
+    arrow->setVisible(false);
+    free_arrows[arrow->color().rgba()].push_back(arrow);
+}
+
+
+void ItemPool::recycle(Square* square){
+    square->setVisible(false);
+    (square->isXDirection() ? free_x_squares : free_z_squares).push_back(square);
+}
+
+
+void ItemPool::recycle(Ball* ball){
+    ball->setVisible(false);
+    free_balls[ball->color().rgba()].push_back(ball);
+}
+
+
+PathRenderer::PathRenderer(Q3DSurface* graph) : m_graph(graph){
+    proxy = new QSurfaceDataProxy;
+    setDataProxy(proxy);
     setDrawMode(QSurface3DSeries::DrawSurface);
-    setBaseColor(color);
     setColorStyle(Q3DTheme::ColorStyleUniform);
     m_graph->addSeries(this);
-    layer++;
-    this_layer = layer;
-    x_range = m_graph->axisX()->max() - m_graph->axisX()->min();
-    y_range = m_graph->axisY()->max() - m_graph->axisY()->min();
-    z_range = m_graph->axisZ()->max() - m_graph->axisZ()->min();
+}
+
+
+int PathRenderer::addLine(Line* line){
+    scheduleTextureUpdate();
+    auto free_layer = std::find(lines.begin(), lines.end(), nullptr);
+    if (free_layer != lines.end()){
+        *free_layer = line;
+        return free_layer - lines.begin();
+    }
+    lines.push_back(line);
+    proxy->addRows(line->getBlankRows(kPathRegionRows));
+    return lines.size() - 1;
+}
+
+
+void PathRenderer::removeLine(Line* line){
+    // the region stays, blank, for the next line to take the layer
+    lines[line->layer] = nullptr;
+}
+
+
+int PathRenderer::lineStart(const Line* line) const{
+    return line->layer * kPathRegionRows + kPathMarginRows;
+}
+
+
+void PathRenderer::scheduleTextureUpdate(){
+    if (texture_update_pending) return;
+    texture_update_pending = true;
+    QTimer::singleShot(0, this, [this](){updateTexture();});
+}
+
+
+void PathRenderer::updateTexture(){
+    texture_update_pending = false;
+    int num_lines = int(lines.size()) * kPathTextureBandHeight;
+    if (num_lines == 0) return;
+    // the texture spans the rows, so band k covers the region of layer k. the
+    // surface's first row samples the image's last line.
+    QImage texture(2, num_lines, QImage::Format_RGB32);
+    texture.fill(Qt::black);
+    for (size_t layer = 0; layer < lines.size(); layer++){
+        if (lines[layer] == nullptr) continue;
+        QRgb color = lines[layer]->m_color.rgb();
+        for (int i = 0; i < kPathTextureBandHeight; i++){
+            int line = num_lines - 1 - (int(layer) * kPathTextureBandHeight + i);
+            QRgb* pixels = reinterpret_cast<QRgb*>(texture.scanLine(line));
+            pixels[0] = pixels[1] = color;
+        }
+    }
+    setTexture(texture);
+}
+
+
+Line::Line(PathRenderer* renderer, QColor color, Surface::BatchFunction _f)
+    : renderer(renderer),
+      m_graph(renderer->graph()),
+      transform(PlotTransform::forGraph(m_graph)),
+      m_color(color),
+      f(_f)
+{
+    x_range = transform->xRange();
+    y_range = transform->yRange();
+    z_range = transform->zRange();
+    updateBlankPoint();
+    layer = renderer->addLine(this);
+}
+
+
+Line::~Line(){
+    removeRows();
+    renderer->removeLine(this);
 }
 
 
 void Line::addPoint(Point p){
     // don't include points that are out of the bound. need to change
     // this hacky fix if the axes range can dynamically change during rendering
-    if (p.x > m_graph->axisX()->max() || p.x < m_graph->axisX()->min() ||
-        p.z > m_graph->axisZ()->max() || p.z < m_graph->axisZ()->min())
+    if (p.x > transform->maxX() || p.x < transform->minX() ||
+        p.z > transform->maxZ() || p.z < transform->minZ())
         return;
     // to make it computationally efficient, don't add crosslines
     // when they are too close to each other
@@ -187,106 +507,204 @@ void Line::addPoint(Point p){
     }
 
 
-    CrossLine new_crossline(p);
-    if (crosslines.empty()){
-        new_crossline.left.x = p.x - kLineHalfWidth * x_range;
-        new_crossline.right.x = p.x + kLineHalfWidth * x_range;
+    crosslines.push_back(CrossLine(p));
+    computeEdges(crosslines.size() - 1);
+    if (crosslines.size() > kLineMaxCrosslines) decimate();
+}
+
+
+void Line::computeEdges(size_t idx){
+    CrossLine& crossline = crosslines[idx];
+    Point p = crossline.center;
+    if (idx == 0){
+        crossline.left = crossline.right = p;
+        crossline.left.x = p.x - kLineHalfWidth * x_range;
+        crossline.right.x = p.x + kLineHalfWidth * x_range;
     } else{
         // calculate the left and right edge of the previous point
         // make them perpendicular to the direction of the line between the last two
         // points. This way, the ribbon appears to have equal width regardless of its
         // orientation.
-        Point last_point = crosslines.back().center;
+        Point last_point = crosslines[idx - 1].center;
         QVector2D normal(p.x - last_point.x, p.z - last_point.z);
         normal.normalize();
 
-        new_crossline.left.x = p.x - kLineHalfWidth * x_range * normal.y();
-        new_crossline.left.z = p.z + kLineHalfWidth * z_range * normal.x();
-        new_crossline.right.x = p.x + kLineHalfWidth * x_range * normal.y();
-        new_crossline.right.z = p.z - kLineHalfWidth * z_range * normal.x();
+        crossline.left.x = p.x - kLineHalfWidth * x_range * normal.y();
+        crossline.left.z = p.z + kLineHalfWidth * z_range * normal.x();
+        crossline.right.x = p.x + kLineHalfWidth * x_range * normal.y();
+        crossline.right.z = p.z - kLineHalfWidth * z_range * normal.x();
     }
-    crosslines.push_back(new_crossline);
+    double xs[2] = {crossline.left.x, crossline.right.x};
+    double zs[2] = {crossline.left.z, crossline.right.z};
+    double ys[2];
+    f(xs, zs, ys, 2);
+    crossline.left_y = ys[0];
+    crossline.right_y = ys[1];
 }
 
 
-QSurfaceDataArray* Line::getDataArray(){
-    if (crosslines.empty()) return nullptr;
-    QSurfaceDataArray *dataArray = new QSurfaceDataArray;
-    int end_idx = crosslines.size();
-    dataArray->reserve(end_idx);
-    for (int idx = 0; idx < end_idx; idx++){
-        *dataArray << getDataRow(idx);
+double distanceToSegment(Point p, Point a, Point b){
+    double dx = b.x - a.x, dz = b.z - a.z;
+    double length_squared = dx * dx + dz * dz;
+    double t = length_squared > 0 ?
+                ((p.x - a.x) * dx + (p.z - a.z) * dz) / length_squared : 0.;
+    t = std::max(0., std::min(1., t));
+    double ex = a.x + t * dx - p.x, ez = a.z + t * dz - p.z;
+    return sqrt(ex * ex + ez * ez);
+}
+
+
+void Line::decimate(){
+    // shrinking to 3/4 or less means this runs at most once per
+    // kLineMaxCrosslines / 4 crosslines
+    if (decimation_tolerance == 0.)
+        decimation_tolerance = kLineHalfWidth * std::min(x_range, z_range) / 4;
+    decimatePath(crosslines, kLineMaxCrosslines, decimation_tolerance,
+                 [](const CrossLine& crossline){return crossline.center;});
+
+    // the old part's neighbours changed; so did its edges. the first
+    // full-detail crossline's predecessor is unchanged.
+    size_t prefix_size = crosslines.size() - kLineFullDetail + 1;
+    for (size_t i = 1; i < prefix_size; i++)
+        computeEdges(i);
+
+    // the rows after the prefix move up; rewrite them all
+    need_full_rebuild = true;
+}
+
+
+QSurfaceDataArray Line::getSegmentRows(){
+    QSurfaceDataArray rows = getDataRows(0, crosslines.size());
+    rows.prepend(getCollapsedRow(0));
+    rows.append(getCollapsedRow(crosslines.size() - 1));
+    return rows;
+}
+
+
+QSurfaceDataArray Line::getDataRows(int begin, int end){
+    QSurfaceDataArray rows;
+    rows.reserve(end - begin);
+    for (int idx = begin; idx < end; idx++){
+        rows << getDataRow(idx);
     }
-    return dataArray;
+    return rows;
 }
 
 
 QSurfaceDataRow* Line::getDataRow(int idx){
+    // only a copy of the cached heights; no surface evaluation
+    const CrossLine& crossline = crosslines[idx];
+    float y_offset = kLineLayerHeight * y_range * (layer + 1);
     QSurfaceDataRow* new_row = new QSurfaceDataRow(2);
-    int index = 0;
-    for (Point p : {crosslines[idx].left, crosslines[idx].right}) {
-        float y = f(p.x, p.z) + kLineLayerHeight * y_range * (layer - this_layer + 1);
-        (*new_row)[index++].setPosition(QVector3D(p.x, y, p.z));
-    }
+    (*new_row)[0].setPosition(QVector3D(crossline.left.x, crossline.left_y + y_offset,
+                                        crossline.left.z));
+    (*new_row)[1].setPosition(QVector3D(crossline.right.x, crossline.right_y + y_offset,
+                                        crossline.right.z));
     return new_row;
 }
 
 
-QSurfaceDataRow* Line::getDataRow(){
-    return getDataRow(crosslines.size() - 1);
+QSurfaceDataRow* Line::getCollapsedRow(int idx){
+    QSurfaceDataRow* row = getDataRow(idx);
+    (*row)[1] = (*row)[0];
+    return row;
 }
 
+
+QSurfaceDataArray Line::getBlankRows(int count){
+    QSurfaceDataArray rows;
+    rows.reserve(count);
+    for (int i = 0; i < count; i++){
+        QSurfaceDataRow* row = new QSurfaceDataRow(2);
+        (*row)[0].setPosition(blank_point);
+        (*row)[1].setPosition(blank_point);
+        rows << row;
+    }
+    return rows;
+}
+
+
+void Line::updateBlankPoint(){
+    double x = (transform->minX() + transform->maxX()) / 2;
+    double z = (transform->minZ() + transform->maxZ()) / 2;
+    double y;
+    f(&x, &z, &y, 1);
+    blank_point = QVector3D(x, y, z);
+}
+
+
 void Line::render(){
-    /* render in the most efficient way:
-     * if there are small changes, just rewrite the last few rows;
-     * if there are major changes, rewrite the whole data array so that
-     * the proxy doesn't issue new requests to render everytime we write a row
+    /* the line's rows sit at a fixed place in the renderer's proxy and are
+     * only ever replaced with setRows, so the row count, the other lines'
+     * rows and the texture stay as they are. a frame sets the rows of the
+     * crosslines added since the last one (and of a replaced last crossline)
+     * and the collapsed row after them. a decimation simplifies the whole
+     * old part and moves the rows after it up, so it rewrites all of the
+     * line's rows, up to kLineMaxCrosslines + 2 in one frame; it comes at
+     * most once per kLineMaxCrosslines / 4 crosslines added. on average, for
+     * one point per frame, a frame sets about 3 rows however long the run.
      */
     m_visible = true;
-    int data_size = crosslines.size();
-    int rendered_data_size = line_proxy->rowCount();
-    Q_ASSERT(rendered_data_size <= data_size);
-
-    if (rendered_data_size == 0){
-        line_proxy->resetArray(getDataArray());
-    } else if (need_to_replace_last_row){
-        need_to_replace_last_row = false;
-        if (data_size - rendered_data_size){
-            line_proxy->setRow(rendered_data_size - 1, getDataRow());
-        } else if (data_size - rendered_data_size <= 5){
-            line_proxy->removeRows(rendered_data_size - 1, 1);
-            for (int i = rendered_data_size; i < data_size; i++){
-                line_proxy->addRow(getDataRow(i));
-            }
-        } else{
-            line_proxy->resetArray(getDataArray());
-        }
-    } else{
-        if (data_size - rendered_data_size <= 5){
-            for (int i = rendered_data_size; i < data_size; i++){
-                line_proxy->addRow(getDataRow(i));
-            }
-        } else{
-            line_proxy->resetArray(getDataArray());
-        }
+    if (crosslines.empty()) return;
+    if (need_full_rebuild || rendered == 0){
+        rebuildRows();
+        return;
     }
+
+    int data_size = crosslines.size();
+    Q_ASSERT(rendered <= data_size);
+    int first = need_to_replace_last_row ? rendered - 1 : rendered;
+    need_to_replace_last_row = false;
+    if (first == data_size) return;
+    // crosslines [first, data_size) are rows 1 + first on, then the
+    // collapsed last row
+    QSurfaceDataArray rows = getDataRows(first, data_size);
+    rows << getCollapsedRow(data_size - 1);
+    renderer->proxy->setRows(renderer->lineStart(this) + 1 + first, rows);
+    rendered = data_size;
+    used_rows = std::max(used_rows, data_size + 2);
+}
+
+
+void Line::rebuildRows(){
+    QSurfaceDataArray rows = getSegmentRows();
+    int new_used_rows = rows.size();
+    // blank whatever the line drew past its new end
+    if (used_rows > new_used_rows) rows << getBlankRows(used_rows - new_used_rows);
+    renderer->proxy->setRows(renderer->lineStart(this), rows);
+    used_rows = new_used_rows;
+    rendered = crosslines.size();
+    need_full_rebuild = false;
+    need_to_replace_last_row = false;
+}
+
+
+void Line::removeRows(){
+    if (used_rows == 0) return;
+    renderer->proxy->setRows(renderer->lineStart(this), getBlankRows(used_rows));
+    used_rows = 0;
+    rendered = 0;
 }
 
 
 void Line::erase(){
     // clears the line on the screen and the internally stored data
-    line_proxy->resetArray(nullptr);
+    removeRows();
     crosslines = {};
+    need_full_rebuild = false;
+    need_to_replace_last_row = false;
+    decimation_tolerance = 0.;
     // Note: fragile code. This assumes everytime the graph
     // changes range, this erase function is called (through reset).
-    x_range = m_graph->axisX()->max() - m_graph->axisX()->min();
-    y_range = m_graph->axisY()->max() - m_graph->axisY()->min();
-    z_range = m_graph->axisZ()->max() - m_graph->axisZ()->min();
+    x_range = transform->xRange();
+    y_range = transform->yRange();
+    z_range = transform->zRange();
+    updateBlankPoint();
 }
 
 
 void Line::setVisible(bool visible){
     if (visible == m_visible) return;
     m_visible = visible;
-    visible ? render() : line_proxy->resetArray(nullptr);
+    visible ? render() : removeRows();
 }
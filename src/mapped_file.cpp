@@ -0,0 +1,84 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, Access access){
+    close();
+    DWORD flags = access == sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, flags, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0){
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr){
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr){
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    m_data = static_cast<const unsigned char*>(view);
+    m_size = size_t(size.QuadPart);
+    return true;
+}
+
+
+void MappedFile::close(){
+    if (m_data != nullptr) UnmapViewOfFile(m_data);
+    if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+    if (file_handle != nullptr) CloseHandle(file_handle);
+    m_data = nullptr;
+    m_size = 0;
+    file_handle = mapping_handle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, Access access){
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0){
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    // front to back: let the kernel read ahead. random: only read what is touched
+    madvise(view, size_t(info.st_size), access == sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    m_data = static_cast<const unsigned char*>(view);
+    m_size = size_t(info.st_size);
+    return true;
+}
+
+
+void MappedFile::close(){
+    if (m_data != nullptr)
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif
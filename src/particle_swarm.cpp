@@ -0,0 +1,138 @@
+#include "particle_swarm.h"
+
+#include <algorithm>
+
+#include <QtDataVisualization/QSurfaceDataProxy>
+
+
+ParticleSwarm::ParticleSwarm(Q3DSurface* graph, ThreadPool* pool, int num_particles)
+    : m_graph(graph),
+      transform(PlotTransform::forGraph(graph)),
+      num_particles(num_particles),
+      pool(pool)
+{}
+
+
+ParticleSwarm::~ParticleSwarm(){
+    for (auto& cloud : clouds)
+        m_graph->removeSeries(cloud.series.get());
+}
+
+
+void ParticleSwarm::addDescent(GradientDescent* prototype, QColor color){
+    Cloud cloud;
+    cloud.prototype = prototype;
+    cloud.series = std::unique_ptr<QSurface3DSeries>(new QSurface3DSeries);
+    cloud.series->setDrawMode(QSurface3DSeries::DrawSurface);
+    cloud.series->setBaseColor(color);
+    cloud.series->setColorStyle(Q3DTheme::ColorStyleUniform);
+    cloud.series->setFlatShadingEnabled(true);
+    m_graph->addSeries(cloud.series.get());
+    clouds.push_back(std::move(cloud));
+}
+
+
+void ParticleSwarm::reset(){
+    std::uniform_real_distribution<double>
+            x_distribution(transform->minX(), transform->maxX()),
+            z_distribution(transform->minZ(), transform->maxZ());
+    std::vector<Point> starting_points(num_particles);
+    for (Point& p : starting_points){
+        p.x = x_distribution(random_engine);
+        p.z = z_distribution(random_engine);
+    }
+
+    for (auto& cloud : clouds){
+        cloud.batches.clear();
+        for (size_t begin = 0; begin < starting_points.size(); begin += kSwarmBatchSize){
+            size_t end = std::min(starting_points.size(), begin + kSwarmBatchSize);
+            BatchGradientDescent* batch = new BatchGradientDescent(cloud.prototype);
+            batch->setStartingPositions(std::vector<Point>(
+                    starting_points.begin() + begin, starting_points.begin() + end));
+            cloud.batches.push_back(std::unique_ptr<BatchGradientDescent>(batch));
+        }
+        // the proxy deletes the old rows
+        cloud.rows = new QSurfaceDataArray;
+        cloud.rows->reserve(3 * num_particles);
+        for (int i = 0; i < 3 * num_particles; i++)
+            *cloud.rows << new QSurfaceDataRow(2);
+        cloud.series->dataProxy()->resetArray(cloud.rows);
+    }
+    render();
+}
+
+
+void ParticleSwarm::step(int num_steps){
+    std::vector<BatchGradientDescent*> batches;
+    for (auto& cloud : clouds){
+        for (auto& batch : cloud.batches)
+            batches.push_back(batch.get());
+    }
+    pool->parallelFor(batches.size(), 1, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            for (int n = 0; n < num_steps; n++)
+                batches[i]->takeGradientSteps();
+        }
+    });
+}
+
+
+void ParticleSwarm::render(){
+    /* particles that left the plot collapse to a point on its edge: the
+     * surface renderer only draws data inside the axis ranges, and the axes
+     * would otherwise grow to fit them
+     */
+    float min_x = transform->minX(), max_x = transform->maxX();
+    float min_z = transform->minZ(), max_z = transform->maxZ();
+    float half_width_x = kParticleHalfWidth * transform->xRange();
+    float half_width_z = kParticleHalfWidth * transform->zRange();
+    float y_offset = kParticleYOffset * transform->yRange();
+
+    std::vector<double> xs(num_particles), zs(num_particles), ys(num_particles);
+    for (auto& cloud : clouds){
+        if (cloud.rows == nullptr) continue;
+        // the clamped positions first, so the heights take one batch call
+        size_t n = 0;
+        for (auto& batch : cloud.batches){
+            for (size_t i = 0; i < batch->size(); i++, n++){
+                Point p = batch->position(i);
+                xs[n] = std::max(min_x, std::min(max_x, float(p.x)));
+                zs[n] = std::max(min_z, std::min(max_z, float(p.z)));
+            }
+        }
+        GradientDescent::f(xs.data(), zs.data(), ys.data(), n);
+
+        n = 0;
+        for (auto& batch : cloud.batches){
+            for (size_t i = 0; i < batch->size(); i++, n++){
+                Point p = batch->position(i);
+                float x = xs[n];
+                float z = zs[n];
+                float y = ys[n] + y_offset;
+                float dx = half_width_x, dz = half_width_z;
+                if (x != float(p.x) || z != float(p.z)) dx = dz = 0.f;
+                // the sides of the diamond stay within the plot too
+                dx = std::min(dx, std::min(x - min_x, max_x - x));
+                dz = std::min(dz, std::min(z - min_z, max_z - z));
+
+                QSurfaceDataRow& top = *(*cloud.rows)[3 * n];
+                QSurfaceDataRow& middle = *(*cloud.rows)[3 * n + 1];
+                QSurfaceDataRow& bottom = *(*cloud.rows)[3 * n + 2];
+                top[0].setPosition(QVector3D(x, y, z + dz));
+                top[1] = top[0];
+                middle[0].setPosition(QVector3D(x - dx, y, z));
+                middle[1].setPosition(QVector3D(x + dx, y, z));
+                bottom[0].setPosition(QVector3D(x, y, z - dz));
+                bottom[1] = bottom[0];
+            }
+        }
+        // same array: the proxy only signals that its contents changed
+        cloud.series->dataProxy()->resetArray(cloud.rows);
+    }
+}
+
+
+void ParticleSwarm::setVisible(bool visible){
+    for (auto& cloud : clouds)
+        cloud.series->setVisible(visible);
+}
@@ -1,20 +1,32 @@
 #include "plot_area.h"
+#include "surface_kernels.h"
+#include "trajectory_file.h"
+
+#include <math.h>
+#include <algorithm>
 
 #include <QtDataVisualization/qvalue3daxis.h>
 #include <QtDataVisualization/q3dscene.h>
 #include <QtDataVisualization/q3dcamera.h>
 #include <QtCore/qmath.h>
+#include <QtGui/QImageReader>
 
 using namespace QtDataVisualization;
 
-const int sampleCountX = 51;
-const int sampleCountZ = 51;
+const int kMeshRowsPerTask = 16;
 const float kCameraMoveStepSize = 0.1f;
 const float kCameraZoomStepSize = 10.f;
 const float minX = -2.0f;
 const float maxX = 2.0f;
 const float minZ = -2.0f;
 const float maxZ = 2.0f;
+const int kBasinMapResolution = 512;
+const int kBasinMapRefreshInterval = 100; // ms
+const size_t kMaxOverlayTrajectories = 16;
+// heights of white in image heightmaps, as wide as the plotted area
+const float kImageHeightRange = 4.f;
+const QColor kOverlayColors[] = {Qt::darkMagenta, Qt::darkYellow, Qt::darkBlue,
+                                 Qt::darkGreen, Qt::darkRed, Qt::black};
 
 PlotArea::PlotArea(Q3DSurface *surface)
     : m_graph(surface),
@@ -22,13 +34,19 @@ PlotArea::PlotArea(Q3DSurface *surface)
       m_surfaceSeries(new QSurface3DSeries(m_surfaceProxy.get()))
 {
     initializeAxes();
+    paths = std::unique_ptr<PathRenderer>(new PathRenderer(m_graph.get()));
     initializeAnimations();
+    for (auto animation : all_animations)
+        simulation.addDescent(animation->descent.get(), &animation->samples,
+                              &animation->timeline);
     // should be called after animations are initialized because it needs
     // to reset the starting points
     initializeSurface();
 
     QObject::connect(&m_timer, &QTimer::timeout, this,
                      &PlotArea::triggerAnimation);
+    QObject::connect(&basin_timer, &QTimer::timeout, this,
+                     &PlotArea::updateBasinMap);
 
     // restart animation from selected position on mouse click
     QObject::connect(m_surfaceSeries.get(),
@@ -38,7 +56,28 @@ PlotArea::PlotArea(Q3DSurface *surface)
     playAnimation();
 }
 
-PlotArea::~PlotArea(){}
+PlotArea::~PlotArea(){
+    stopBasinMap();
+    // abandon a surface still being built
+    ++surface_generation;
+    if (surface_thread.joinable()) surface_thread.join();
+    // m_graph is declared after the items' owners, so it would go first; give
+    // the items back to its ItemPool (and the Lines their rows) while it is
+    // still there. the simulation stays paused until it is destroyed, so it
+    // never steps a descent that is gone.
+    simulation.pause();
+    swarm.reset();
+    overlays.clear();
+    all_animations.clear();
+    gradient_descent.reset();
+    momentum.reset();
+    qhm.reset();
+    ada_grad.reset();
+    rms_prop.reset();
+    adam.reset();
+    qhadam.reset();
+    paths.reset();
+}
 
 
 void PlotArea::initializeAxes(){
@@ -76,46 +115,108 @@ void PlotArea::initializeAxes(){
 
 void PlotArea::initializeAnimations(){
     gradient_descent = std::unique_ptr<GradientDescentAnimation>(
-                new GradientDescentAnimation(m_graph.get(), &m_timer));
+                new GradientDescentAnimation(m_graph.get(), paths.get(), &m_timer));
     momentum = std::unique_ptr<Animation>(
-                new MomentumAnimation(m_graph.get(), &m_timer));
+                new MomentumAnimation(m_graph.get(), paths.get(), &m_timer));
     qhm = std::unique_ptr<Animation>(
-            new QHMAnimation( m_graph.get(), &m_timer ) );
+            new QHMAnimation( m_graph.get(), paths.get(), &m_timer ) );
     ada_grad = std::unique_ptr<Animation>(
-            new AdaGradAnimation( m_graph.get(), &m_timer ) );
+            new AdaGradAnimation( m_graph.get(), paths.get(), &m_timer ) );
     rms_prop = std::unique_ptr<Animation>(
-                new RMSPropAnimation(m_graph.get(), &m_timer));
+                new RMSPropAnimation(m_graph.get(), paths.get(), &m_timer));
     adam = std::unique_ptr<Animation>(
-                new AdamAnimation(m_graph.get(), &m_timer));
+                new AdamAnimation(m_graph.get(), paths.get(), &m_timer));
     qhadam = std::unique_ptr<Animation>(
-            new QHAdamAnimation( m_graph.get(), &m_timer ) );
+            new QHAdamAnimation( m_graph.get(), paths.get(), &m_timer ) );
     all_animations
             = { gradient_descent.get(), momentum.get(), qhm.get(),
                     ada_grad.get(), rms_prop.get(), adam.get(), qhadam.get() };
 }
 
 
-void PlotArea::initializeSurface() {
-    float stepX = (maxX - minX) / float(sampleCountX - 1);
-    float stepZ = (maxZ - minZ) / float(sampleCountZ - 1);
-
-    QSurfaceDataArray *dataArray = new QSurfaceDataArray;
-    dataArray->reserve(sampleCountZ);
-    for (int i = 0 ; i < sampleCountZ ; i++) {
-        QSurfaceDataRow *newRow = new QSurfaceDataRow(sampleCountX);
-        // Keep values within range bounds, since just adding step can cause minor drift due
-        // to the rounding errors.
-        float z = qMin(maxZ, (i * stepZ + minZ));
-        int index = 0;
-        for (int j = 0; j < sampleCountX; j++) {
-            float x = qMin(maxX, (j * stepX + minX));
-            float y = GradientDescent::f(x, z);
-            (*newRow)[index++].setPosition(QVector3D(x, y, z));
-        }
-        *dataArray << newRow;
+namespace {
+// coordinate i of a grid of resolution points from min to max. Keep values
+// within range bounds, since just adding step can cause minor drift due to
+// the rounding errors.
+float gridCoordinate(int i, float min, float max, int resolution){
+    return qMin(max, i * (max - min) / float(resolution - 1) + min);
+}
+
+
+// evaluates the surface on the grid, a block of rows per task, each row with
+// one batch call
+struct MeshBuilder {
+    Function::FunctionName function_name;
+    // sampled instead of Surface::customExpression() and Surface::heightmap()
+    const Expression* expression;
+    const Heightmap* heightmap;
+    float* heights;
+    int resolution;
+    ThreadPool* pool;
+    // stop early once the current generation isn't this one any more
+    const std::atomic<int>* current_generation;
+    int generation;
+
+    void build(){
+        std::vector<double> xs(resolution);
+        for (int j = 0; j < resolution; j++)
+            xs[j] = gridCoordinate(j, minX, maxX, resolution);
+        pool->parallelFor(resolution, kMeshRowsPerTask, [&](size_t begin, size_t end){
+            if (*current_generation != generation) return;
+            std::vector<double> zs(resolution), values(resolution);
+            for (size_t i = begin; i < end; i++){
+                std::fill(zs.begin(), zs.end(), gridCoordinate(i, minZ, maxZ, resolution));
+                if (function_name == Function::custom)
+                    SurfaceKernels::evaluate(*expression, xs.data(), zs.data(),
+                                             values.data(), resolution);
+                else if (function_name == Function::heightmap)
+                    SurfaceKernels::evaluate(*heightmap, xs.data(), zs.data(),
+                                             values.data(), resolution);
+                else
+                    SurfaceKernels::evaluate(function_name, xs.data(), zs.data(),
+                                             values.data(), resolution);
+                std::copy(values.begin(), values.end(), heights + i * resolution);
+            }
+        });
     }
-    m_surfaceProxy->resetArray(dataArray);
+};
+
+
+QSurfaceDataArray* makeSurfaceArray(const float* heights, int resolution, ThreadPool& pool){
+    QSurfaceDataArray* data_array = new QSurfaceDataArray;
+    data_array->reserve(resolution);
+    for (int i = 0; i < resolution; i++)
+        *data_array << new QSurfaceDataRow(resolution);
+    pool.parallelFor(resolution, kMeshRowsPerTask, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            QSurfaceDataRow& row = *(*data_array)[i];
+            float z = gridCoordinate(i, minZ, maxZ, resolution);
+            for (int j = 0; j < resolution; j++){
+                float x = gridCoordinate(j, minX, maxX, resolution);
+                row[j].setPosition(QVector3D(x, heights[i * resolution + j], z));
+            }
+        }
+    });
+    return data_array;
+}
+
+
+void deleteSurfaceArray(QSurfaceDataArray* data_array){
+    qDeleteAll(*data_array);
+    delete data_array;
+}
+}
+
+
+void PlotArea::initializeSurface() {
+    int generation = surface_generation;
+    m_surfaceProxy->resetArray(buildSurfaceArray(
+            SurfaceChoice(GradientDescent::function_name), surface_resolution, generation));
+    initializeStartingPositions();
+}
+
 
+void PlotArea::initializeStartingPositions(){
     // make sure starting point is within view port
     for (auto animation : all_animations){
         animation->descent->setStartingPosition(
@@ -124,35 +225,192 @@ void PlotArea::initializeSurface() {
 }
 
 
-void PlotArea::pauseAnimation() {m_timer.stop();}
+QSurfaceDataArray* PlotArea::buildSurfaceArray(const SurfaceChoice& surface,
+                                               int resolution, int generation){
+    /* the heights of the surfaces and resolutions shown recently are kept,
+     * so going back to one only refills the rows. runs on the GUI thread or
+     * on surface_thread; returns nullptr if a newer request made it pointless.
+     */
+    std::lock_guard<std::mutex> lock(mesh_mutex);
+    std::string key = Surface::functionName(surface.function_name);
+    if (surface.function_name == Function::custom)
+        key += ":" + surface.expression->text();
+    else if (surface.function_name == Function::heightmap)
+        key += ":" + std::to_string(surface.heightmap->id());
+    const std::pair<std::string, int> cache_key = std::make_pair(key, resolution);
+    CachedMesh& mesh = mesh_cache[cache_key];
+    mesh.last_used = ++mesh_cache_clock;
+    std::vector<float>& heights = mesh.heights;
+    if (heights.empty()){
+        heights.resize(size_t(resolution) * resolution);
+        MeshBuilder builder = {surface.function_name, surface.expression.get(),
+                               surface.heightmap.get(), heights.data(), resolution,
+                               &frame_pool, &surface_generation, generation};
+        builder.build();
+        if (surface_generation != generation){
+            mesh_cache.erase(cache_key);
+            return nullptr;
+        }
+        evictMeshes(cache_key);
+    }
+    return makeSurfaceArray(heights.data(), resolution, frame_pool);
+}
+
+
+void PlotArea::evictMeshes(const std::pair<std::string, int>& keep){
+    // least recently used first. the cache is small enough to scan
+    size_t total = 0;
+    for (const auto& entry : mesh_cache) total += entry.second.heights.size();
+    while (total > kMeshCacheBudget){
+        auto oldest = mesh_cache.end();
+        for (auto it = mesh_cache.begin(); it != mesh_cache.end(); ++it){
+            if (it->first != keep &&
+                (oldest == mesh_cache.end() || it->second.last_used < oldest->second.last_used))
+                oldest = it;
+        }
+        if (oldest == mesh_cache.end()) break;
+        total -= oldest->second.heights.size();
+        mesh_cache.erase(oldest);
+    }
+}
+
+
+void PlotArea::requestSurface(const SurfaceChoice& surface){
+    /* build the mesh on surface_thread; the current surface stays up and
+     * interactive until applySurface swaps the new one in. a newer request
+     * makes an older one stop early and drop its result.
+     */
+    int generation = ++surface_generation;
+    if (surface_thread.joinable()) surface_thread.join();
+    int resolution = surface_resolution;
+    surface_thread = std::thread([this, surface, resolution, generation](){
+        QSurfaceDataArray* data_array = buildSurfaceArray(surface, resolution, generation);
+        if (data_array == nullptr) return;
+        QMetaObject::invokeMethod(this, [this, surface, generation, data_array](){
+            applySurface(surface, generation, data_array);
+        }, Qt::QueuedConnection);
+    });
+}
+
+
+void PlotArea::applySurface(const SurfaceChoice& surface, int generation,
+                            QSurfaceDataArray* data_array){
+    if (generation != surface_generation){
+        deleteSurfaceArray(data_array);
+        return;
+    }
+    const Function::FunctionName function_name = surface.function_name;
+    bool new_expression = function_name == Function::custom &&
+            surface.expression != Surface::customExpression();
+    bool new_heightmap = function_name == Function::heightmap &&
+            surface.heightmap != Surface::heightmap();
+    if (function_name == GradientDescent::function_name && !new_expression && !new_heightmap){
+        // only the resolution changed
+        m_surfaceProxy->resetArray(data_array);
+        return;
+    }
+    SimulationThread::ScopedPause pause(simulation);
+    if (new_expression || new_heightmap){
+        /* nothing may evaluate the old one while it is replaced */
+        stopBasinMap();
+        Surface::setCustomExpression(surface.expression);
+        Surface::setHeightmap(surface.heightmap);
+    }
+    GradientDescent::function_name = function_name;
+    overlays.clear();
+    m_surfaceProxy->resetArray(data_array);
+    initializeStartingPositions();
+    resetAnimations();
+    if (basin_descent != nullptr) startBasinMap();
+}
+
+
+void PlotArea::setSurfaceResolution(int index){
+    int resolution = kDefaultSurfaceResolution;
+    switch (index) {
+        case 0: break;
+        case 1: resolution = 101; break;
+        case 2: resolution = 256; break;
+        case 3: resolution = 1024; break;
+    }
+    if (resolution == surface_resolution) return;
+    surface_resolution = resolution;
+    requestSurface(SurfaceChoice(GradientDescent::function_name));
+}
+
+
+void PlotArea::pauseAnimation() {
+    m_timer.stop();
+    simulation.pause();
+}
 
 void PlotArea::playAnimation(){
     if (!m_timer.isActive()) m_timer.start(15);
+    if (!detailedView) simulation.resume();
 }
 
 
 void PlotArea::triggerAnimation() {
-    if (timer_counter == 0){
-        if (detailedView){
+    if (detailedView){
+        if (timer_counter == 0){
             QString message = detailed_descent->triggerDetailedAnimation(animation_speedup);
             emit updateMessage(message);
-        } else{
-            for (auto animation : all_animations)
-                animation->triggerSimpleAnimation(animation_speedup,
-                    show_gradient, show_adjusted_gradient, show_momentum,
-                    show_gradient_squared, show_path);
         }
+        timer_counter = (timer_counter + 1) % animation_slowdown;
+    } else{
+        // the simulation thread keeps the pace; just draw what it produced
+        for (auto animation : all_animations)
+            animation->triggerSimpleAnimation(
+                show_gradient, show_adjusted_gradient, show_momentum,
+                show_gradient_squared, show_path);
+        updateTimeline();
+        // the swarm is stepped here, at the simulation thread's pace
+        if (swarm != nullptr){
+            if (timer_counter == 0) swarm->step(animation_speedup);
+            timer_counter = (timer_counter + 1) % animation_slowdown;
+            swarm->render();
+        }
+    }
+}
+
+
+void PlotArea::updateTimeline(){
+    int step = 0;
+    int length = 0;
+    for (auto animation : all_animations){
+        step = std::max(step, animation->step());
+        length = std::max(length, animation->timeline.length());
+    }
+    emit timelineChanged(step, length);
+}
+
+
+void PlotArea::seekTimeline(int step){
+    /* put every descent back (or forward) to the given step. descents that
+     * converged earlier stay at their last step.
+     */
+    if (detailedView) return;
+    SimulationThread::ScopedPause pause(simulation);
+    simulation.discardPendingSamples();
+    for (auto animation : all_animations){
+        animation->seek(step);
+        animation->drawLastSample(show_gradient, show_adjusted_gradient,
+                                  show_momentum, show_gradient_squared, show_path);
     }
-    timer_counter = (timer_counter + 1) % animation_slowdown;
+    updateTimeline();
 }
 
 
 void PlotArea::resetAnimations() {
+    SimulationThread::ScopedPause pause(simulation);
+    simulation.discardPendingSamples();
     if (detailedView){
         detailed_descent->resetAnimation();
     } else{
         for (auto& animation : all_animations)
             animation->resetAnimation();
+        updateTimeline();
+        if (swarm != nullptr) swarm->reset();
     }
 }
 
@@ -162,6 +420,7 @@ void PlotArea::restartFromClickedPosition(QPoint q_pos){
         return;
     // convert the 2d Qt internal point for to the 3d point on the series
     QVector3D p = m_surfaceProxy->itemAt(q_pos)->position();
+    SimulationThread::ScopedPause pause(simulation);
     for (auto animation : all_animations){
         animation->descent->setStartingPosition(p.x(), p.z());
     }
@@ -207,6 +466,7 @@ void PlotArea::setAnimationSpeed(int index){
         case 3: animation_speedup = 5; break;
         case 4: animation_speedup = 10; break;
     }
+    simulation.setSpeed(animation_speedup, 15 * animation_slowdown);
 }
 
 
@@ -260,16 +520,33 @@ void PlotArea::setShowPath(bool show){
 }
 
 
+void PlotArea::setShowSwarm(bool show){
+    if (show == (swarm != nullptr)) return;
+    if (show){
+        swarm = std::unique_ptr<ParticleSwarm>(new ParticleSwarm(m_graph.get(), &frame_pool));
+        for (auto animation : all_animations)
+            swarm->addDescent(animation->descent.get(), animation->ball_color);
+        swarm->reset();
+        swarm->setVisible(!detailedView);
+    } else{
+        swarm = nullptr;
+    }
+}
+
+
 void PlotArea::setDetailedAnimation(QString descent_name){
     emit updateMessage("");
     for (auto animation : all_animations){
         if (animation->name == descent_name){
+            // the detailed animation steps its descent itself
+            simulation.pause();
             detailed_descent = animation;
             detailed_descent->resetAnimation();
             for (auto animation : all_animations){
                 if (animation != detailed_descent)
                     animation->cleanupAll();
             }
+            if (swarm != nullptr) swarm->setVisible(false);
             detailedView = true;
             return;
         }
@@ -284,9 +561,11 @@ void PlotArea::setAnimationMode(const int& view_type){
         if (detailed_descent != nullptr)
             detailed_descent->cleanupAll();
         detailedView = false;
+        if (swarm != nullptr) swarm->setVisible(true);
         resetAnimations();
     }
     m_timer.start(15);
+    if (!detailedView) simulation.resume();
 }
 
 
@@ -304,11 +583,202 @@ void PlotArea::changeSurface(QString name){
         function_name = Function::hills;
     } else if (name == "Plateau"){
         function_name = Function::plateau;
+    } else if (name == "Custom"){
+        function_name = Function::custom;
+    } else if (name == "Heightmap"){
+        function_name = Function::heightmap;
     }else{
         return;
     }
+    requestSurface(SurfaceChoice(function_name));
+}
 
-    GradientDescent::function_name = function_name;
-    initializeSurface();
-    resetAnimations();
+
+void PlotArea::setCustomSurface(QString text){
+    std::string error;
+    std::shared_ptr<const Expression> expression =
+            Expression::compile(text.toStdString(), error);
+    if (expression == nullptr){
+        emit updateCustomSurfaceMessage(QString::fromStdString(error));
+        return;
+    }
+    emit updateCustomSurfaceMessage("");
+    if (GradientDescent::function_name != Function::custom)
+        emit surfaceChanged(Function::custom);
+    SurfaceChoice surface(Function::custom);
+    surface.expression = expression;
+    requestSurface(surface);
+}
+
+
+bool PlotArea::loadHeightmap(QString path, QString& error){
+    std::shared_ptr<const Heightmap> heightmap;
+    if (!QImageReader::imageFormat(path).isEmpty()){
+        /* images are decoded into memory. gray levels 0 to 255 become heights
+         * 0 to kImageHeightRange; the first line is the far end of the z axis.
+         */
+        QImage image(path);
+        if (image.isNull() || image.width() < 2 || image.height() < 2){
+            error = QString("%1 is not an image of at least 2 x 2 pixels.").arg(path);
+            return false;
+        }
+        image = image.convertToFormat(QImage::Format_Grayscale8);
+        const size_t width = size_t(image.width());
+        const size_t height = size_t(image.height());
+        std::vector<float> values(width * height);
+        for (size_t i = 0; i < height; i++){
+            const uchar* line = image.constScanLine(int(height - 1 - i));
+            for (size_t j = 0; j < width; j++)
+                values[i * width + j] = line[j] * (kImageHeightRange / 255.f);
+        }
+        heightmap = Heightmap::fromValues(std::move(values), width, height,
+                                          path.toStdString());
+    } else{
+        std::string message;
+        heightmap = Heightmap::openRaw(path.toStdString(), 0, message);
+        if (heightmap == nullptr){
+            error = QString::fromStdString(message);
+            return false;
+        }
+    }
+
+    if (GradientDescent::function_name != Function::heightmap)
+        emit surfaceChanged(Function::heightmap);
+    SurfaceChoice surface(Function::heightmap);
+    surface.heightmap = heightmap;
+    requestSurface(surface);
+    return true;
+}
+
+
+void PlotArea::setSurface(Function::FunctionName function_name){
+    // synchronous, for callers that draw on the new surface right away
+    int generation = ++surface_generation;
+    SurfaceChoice surface(function_name);
+    applySurface(surface, generation,
+                 buildSurfaceArray(surface, surface_resolution, generation));
+}
+
+
+bool PlotArea::loadTrajectory(QString path){
+    TrajectoryReader reader;
+    if (!reader.open(path.toStdString())) return false;
+
+    Function::FunctionName function_name =
+            Function::FunctionName(reader.header().function_name);
+    if (function_name != GradientDescent::function_name){
+        setSurface(function_name);
+        emit surfaceChanged(function_name);
+    }
+    overlays.clear();
+
+    /* replay straight from the mapping. Line drops points closer than
+     * kLineStepSize to the last one anyway; skipping most of them here keeps
+     * runs of 10^8 steps quick to draw.
+     */
+    const double min_distance = kLineStepSize * (maxX - minX) / 2;
+    size_t num_trajectories = std::min(reader.numTrajectories(), kMaxOverlayTrajectories);
+    for (size_t i = 0; i < num_trajectories; i++){
+        QColor color = kOverlayColors[i % (sizeof(kOverlayColors) / sizeof(kOverlayColors[0]))];
+        Line* line = new Line(paths.get(), color, f);
+        overlays.push_back(std::unique_ptr<Line>(line));
+        Point last, end;
+        reader.replay(i, [&](uint64_t record, Point p){
+            if (record == 0 || fabs(p.x - last.x) >= min_distance ||
+                fabs(p.z - last.z) >= min_distance){
+                line->addPoint(p);
+                last = p;
+            }
+            end = p;
+        });
+        // always end where the run ended
+        line->addPoint(end);
+        line->render();
+    }
+    return true;
+}
+
+
+void PlotArea::showBasinMap(QString descent_name){
+    basin_descent = nullptr;
+    for (auto animation : all_animations){
+        if (animation->name == descent_name)
+            basin_descent = animation;
+    }
+    if (basin_descent != nullptr){
+        startBasinMap();
+    } else{
+        stopBasinMap();
+        m_surfaceSeries->setTexture(QImage());
+        emit updateBasinMapMessage("");
+    }
+}
+
+
+void PlotArea::startBasinMap(){
+    stopBasinMap();
+    if (thread_pool == nullptr)
+        thread_pool = std::unique_ptr<ThreadPool>(new ThreadPool);
+
+    GradientDescent* descent = basin_descent->descent.get();
+    basin_map = std::unique_ptr<BasinMap>(new BasinMap(
+                GradientDescent::function_name, descent->optimizerName(),
+                descent->publishedHyperparameters(), kBasinMapResolution,
+                minX, maxX, minZ, maxZ));
+    basin_image = QImage(kBasinMapResolution, kBasinMapResolution, QImage::Format_RGB32);
+    basin_image.fill(Qt::lightGray);
+    m_surfaceSeries->setTexture(basin_image);
+    emit updateBasinMapMessage("Computing...");
+
+    BasinMap* map = basin_map.get();
+    ThreadPool* pool = thread_pool.get();
+    basin_thread = std::thread([map, pool](){map->compute(*pool);});
+    basin_timer.start(kBasinMapRefreshInterval);
+}
+
+
+void PlotArea::stopBasinMap(){
+    basin_timer.stop();
+    if (basin_map != nullptr) basin_map->cancel();
+    if (basin_thread.joinable()) basin_thread.join();
+    basin_map.reset();
+}
+
+
+void PlotArea::updateBasinMap(){
+    /* paint the rows finished since the last update. the hue tells the
+     * minimum a start ended in, the brightness how fast it got there
+     * (bright: few steps). starts that didn't converge are black.
+     */
+    std::vector<int> rows = basin_map->takeFinishedRows();
+    const int n = basin_map->resolution();
+    const double log_max_steps = log(1. + basin_map->max_steps);
+    for (int i : rows){
+        // the texture's first line is at the far end of the z axis
+        QRgb* line = reinterpret_cast<QRgb*>(basin_image.scanLine(n - 1 - i));
+        for (int j = 0; j < n; j++){
+            int basin = basin_map->basin(i, j);
+            if (basin < 0){
+                line[j] = qRgb(0, 0, 0);
+                continue;
+            }
+            double hue = fmod(0.6 + basin * 0.618034, 1.);
+            double value = 1. - 0.7 * log(1. + basin_map->numSteps(i, j)) / log_max_steps;
+            line[j] = QColor::fromHsvF(hue, 0.8, value).rgb();
+        }
+    }
+    if (!rows.empty()) m_surfaceSeries->setTexture(basin_image);
+
+    if (basin_map->isFinished()){
+        basin_timer.stop();
+        basin_thread.join();
+        int num_converged = 0;
+        for (int i = 0; i < n; i++){
+            for (int j = 0; j < n; j++)
+                num_converged += basin_map->basin(i, j) >= 0;
+        }
+        emit updateBasinMapMessage(
+                    QString("%1 minima; %2 of %3 starts converged")
+                    .arg(basin_map->minima().size()).arg(num_converged).arg(n * n));
+    }
 }
@@ -0,0 +1,130 @@
+#include "simulation_thread.h"
+
+#include <chrono>
+
+
+DescentSample takeSample(GradientDescent& descent, int step){
+    DescentSample sample;
+    sample.position = descent.position();
+    sample.gradient = Point(descent.gradX(), descent.gradZ());
+    sample.delta = descent.delta();
+    sample.momentum = descent.momentum();
+    sample.grad_sum_of_squared = descent.gradSumOfSquared();
+    sample.learning_rate = descent.learning_rate;
+    sample.converged = descent.isConverged();
+    sample.step = step;
+    return sample;
+}
+
+
+SimulationThread::SimulationThread(){
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+
+SimulationThread::~SimulationThread(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+
+void SimulationThread::addDescent(GradientDescent* descent,
+                                  SpscQueue<DescentSample>* queue,
+                                  Timeline* timeline){
+    std::lock_guard<std::mutex> lock(mutex);
+    Channel channel = {descent, queue, timeline, DescentSample(), false, false};
+    channels.push_back(channel);
+}
+
+
+void SimulationThread::pause(){
+    // the thread holds the lock for a whole tick, so once we have it no tick
+    // is running, and the next one will see running == false
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+}
+
+
+void SimulationThread::resume(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (running) return;
+        running = true;
+    }
+    wake.notify_all();
+}
+
+
+bool SimulationThread::isRunning(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return running;
+}
+
+
+void SimulationThread::setSpeed(int steps_per_tick, int tick_interval_ms){
+    std::lock_guard<std::mutex> lock(mutex);
+    this->steps_per_tick = steps_per_tick;
+    tick_interval = tick_interval_ms;
+}
+
+
+void SimulationThread::discardPendingSamples(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Channel& channel : channels){
+        channel.has_pending = false;
+        channel.sent_converged = false;
+    }
+}
+
+
+void SimulationThread::run(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true){
+        wake.wait(lock, [this]{return stopping || running;});
+        if (stopping) return;
+
+        auto next_tick = std::chrono::steady_clock::now();
+        while (running && !stopping){
+            tick();
+            next_tick += std::chrono::milliseconds(tick_interval);
+            // after a stall (e.g. a slow surface) don't rush to catch up
+            auto now = std::chrono::steady_clock::now();
+            if (next_tick < now) next_tick = now;
+            wake.wait_until(lock, next_tick, [this]{return stopping || !running;});
+        }
+    }
+}
+
+
+void SimulationThread::tick(){
+    for (Channel& channel : channels){
+        GradientDescent* descent = channel.descent;
+        if (descent->isConverged()){
+            // nothing changes any more; just make sure the app got the last state
+            if (channel.has_pending && channel.queue->push(channel.pending))
+                channel.has_pending = false;
+            if (channel.sent_converged) continue;
+        } else{
+            for (int i = 0; i < steps_per_tick && !descent->isConverged(); i++){
+                descent->takeGradientStep();
+                // the step that finds the descent converged doesn't move it
+                if (!descent->isConverged()) channel.timeline->recordStep(*descent);
+            }
+        }
+
+        DescentSample sample = takeSample(*descent, channel.timeline->currentStep());
+        channel.sent_converged = sample.converged;
+
+        if (channel.has_pending && channel.queue->push(channel.pending))
+            channel.has_pending = false;
+        if (channel.has_pending || !channel.queue->push(sample)){
+            // the app is behind; keep only the newest sample for later
+            channel.pending = sample;
+            channel.has_pending = true;
+        }
+    }
+}
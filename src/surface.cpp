@@ -0,0 +1,26 @@
+#include "surface.h"
+
+namespace Surface{
+namespace {
+const int kNumFunctions = 8;
+const char* const kFunctionNames[kNumFunctions] = {
+    "local_minimum", "global_minimum", "saddle_point", "ecliptic_bowl",
+    "hills", "plateau", "custom", "heightmap"};
+}
+
+
+const char* functionName(Function::FunctionName function_name){
+    return kFunctionNames[function_name];
+}
+
+
+bool functionFromName(const std::string& name, Function::FunctionName& function_name){
+    for (int i = 0; i < kNumFunctions; i++){
+        if (name == kFunctionNames[i]){
+            function_name = Function::FunctionName(i);
+            return true;
+        }
+    }
+    return false;
+}
+}
@@ -0,0 +1,390 @@
+#include "surface_kernels.h"
+#include "batch_kernels.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace SurfaceKernels{
+
+namespace {
+// points per finite difference pass, sized to stay on the stack
+const size_t kFiniteDifferenceChunk = 256;
+// points per pass of an expression program; the registers of a block should
+// fit in L1 for programs of a few dozen instructions
+const size_t kExpressionBlock = 256;
+// up to this many points (e.g. one ball's step) run on the stack instead, if
+// the program has at most kMaxPointRegisters registers
+const size_t kMaxPointBatch = 8;
+const int kMaxPointRegisters = 128;
+
+
+struct Evaluate {
+    const double* xs;
+    const double* zs;
+    double* out;
+    size_t begin, end;
+    template <typename S> void visit(){
+        for (size_t i = begin; i < end; i++)
+            out[i] = S::f(xs[i], zs[i]);
+    }
+};
+
+
+struct EvaluateWithGradient {
+    const double* xs;
+    const double* zs;
+    double* out;
+    double* grad_x;
+    double* grad_z;
+    size_t begin, end;
+    template <typename S> void visit(){
+        for (size_t i = begin; i < end; i++){
+            Point grad;
+            double value = S::valueAndGradient(xs[i], zs[i], grad);
+            if (out != nullptr) out[i] = value;
+            grad_x[i] = grad.x;
+            grad_z[i] = grad.z;
+        }
+    }
+};
+
+
+bool runProgramOnStack(const ExpressionProgram& program, const double* xs, const double* zs,
+                       double* const* outputs, size_t n){
+    /* for a few points, sizing the thread's blocks, filling them with the
+     * constants and picking a vector kernel cost more than the program
+     * itself. the scalar kernel runs on blocks of n on the stack instead.
+     */
+    if (n > kMaxPointBatch || program.num_registers > kMaxPointRegisters) return false;
+    double values[kMaxPointRegisters * kMaxPointBatch];
+    double* registers[kMaxPointRegisters];
+    if (n == 1){
+        /* a single point (a ball's step) copies the registers with the
+         * constants already in place, and the loops over points go away
+         */
+        std::copy(program.point_registers.begin(), program.point_registers.end(), values);
+        for (int r = 2; r < program.num_registers; r++) registers[r] = values + r;
+    } else{
+        for (int r = 2; r < program.num_registers; r++) registers[r] = values + r * n;
+        for (const ExpressionProgram::Constant& constant : program.constants)
+            std::fill(registers[constant.reg], registers[constant.reg] + n, constant.value);
+    }
+    /* the programs never write x and z */
+    registers[0] = const_cast<double*>(xs);
+    registers[1] = const_cast<double*>(zs);
+    if (n == 1) runProgramScalar(program, registers, 0, 1);
+    else runProgramScalar(program, registers, 0, n);
+
+    for (size_t k = 0; k < program.outputs.size(); k++){
+        if (outputs[k] == nullptr) continue;
+        const double* result = registers[program.outputs[k]];
+        std::copy(result, result + n, outputs[k]);
+    }
+    return true;
+}
+
+
+void runProgram(const ExpressionProgram& program, const double* xs, const double* zs,
+                double* const* outputs, size_t n){
+    if (runProgramOnStack(program, xs, zs, outputs, n)) return;
+    /* every instruction runs over a block before the next starts, so the
+     * switch on the op is paid once per block rather than per point.
+     * outputs[k] receives program output k, unless it is nullptr.
+     */
+    thread_local std::vector<double> storage;
+    thread_local std::vector<double*> registers;
+    size_t block = std::min(n, kExpressionBlock);
+    storage.resize(program.num_registers * kExpressionBlock);
+    registers.resize(program.num_registers);
+    for (int r = 0; r < program.num_registers; r++)
+        registers[r] = storage.data() + r * kExpressionBlock;
+    for (const ExpressionProgram::Constant& constant : program.constants)
+        std::fill(registers[constant.reg], registers[constant.reg] + block, constant.value);
+
+    for (size_t begin = 0; begin < n; begin += kExpressionBlock){
+        size_t m = std::min(kExpressionBlock, n - begin);
+        /* the programs never write x and z */
+        registers[0] = const_cast<double*>(xs + begin);
+        registers[1] = const_cast<double*>(zs + begin);
+
+        size_t done = 0;
+        switch (BatchKernels::instructionSet()){
+        case BatchKernels::avx512:
+            done = runProgramAvx512(program, registers.data(), m);
+            break;
+        case BatchKernels::avx2:
+            done = runProgramAvx2(program, registers.data(), m);
+            break;
+        case BatchKernels::scalar:
+            break;
+        }
+        runProgramScalar(program, registers.data(), done, m);
+
+        for (size_t k = 0; k < program.outputs.size(); k++){
+            if (outputs[k] == nullptr) continue;
+            const double* result = registers[program.outputs[k]];
+            std::copy(result, result + m, outputs[k] + begin);
+        }
+    }
+}
+
+
+void sampleHeightmap(const Heightmap& heightmap, const double* xs, const double* zs,
+                     double* out, double* grad_x, double* grad_z, size_t n){
+    size_t done = 0;
+    switch (BatchKernels::instructionSet()){
+    case BatchKernels::avx512:
+        done = sampleHeightmapAvx512(heightmap, xs, zs, out, grad_x, grad_z, n);
+        break;
+    case BatchKernels::avx2:
+        done = sampleHeightmapAvx2(heightmap, xs, zs, out, grad_x, grad_z, n);
+        break;
+    case BatchKernels::scalar:
+        break;
+    }
+    sampleHeightmapScalar(heightmap, xs, zs, out, grad_x, grad_z, done, n);
+}
+
+
+// the Catmull-Rom weights of the 4 samples around t in [0, 1], and their
+// derivatives. surface_kernels_simd.inl does the same operations.
+void catmullRomWeights(double t, double w[4], double d[4]){
+    w[0] = ((-0.5 * t + 1.) * t - 0.5) * t;
+    w[1] = (1.5 * t - 2.5) * t * t + 1.;
+    w[2] = ((-1.5 * t + 2.) * t + 0.5) * t;
+    w[3] = (0.5 * t - 0.5) * t * t;
+    d[0] = (-1.5 * t + 2.) * t - 0.5;
+    d[1] = (4.5 * t - 5.) * t;
+    d[2] = (-4.5 * t + 4.) * t + 0.5;
+    d[3] = (1.5 * t - 1.) * t;
+}
+
+
+void finiteDifferenceGradient(Function::FunctionName function_name,
+                              const double* xs, const double* zs,
+                              double* grad_x, double* grad_z, size_t n){
+    /* central differences, (f(x + epsilon) - f(x - epsilon)) / (2 epsilon),
+     * on a chunk of points at a time
+     */
+    double shifted[kFiniteDifferenceChunk];
+    double f_plus[kFiniteDifferenceChunk];
+    double f_minus[kFiniteDifferenceChunk];
+    for (size_t begin = 0; begin < n; begin += kFiniteDifferenceChunk){
+        size_t m = std::min(kFiniteDifferenceChunk, n - begin);
+        const double* x = xs + begin;
+        const double* z = zs + begin;
+
+        for (size_t i = 0; i < m; i++) shifted[i] = x[i] + kFiniteDiffEpsilon;
+        evaluate(function_name, shifted, z, f_plus, m);
+        for (size_t i = 0; i < m; i++) shifted[i] = x[i] - kFiniteDiffEpsilon;
+        evaluate(function_name, shifted, z, f_minus, m);
+        for (size_t i = 0; i < m; i++)
+            grad_x[begin + i] = (f_plus[i] - f_minus[i]) / (2 * kFiniteDiffEpsilon);
+
+        for (size_t i = 0; i < m; i++) shifted[i] = z[i] + kFiniteDiffEpsilon;
+        evaluate(function_name, x, shifted, f_plus, m);
+        for (size_t i = 0; i < m; i++) shifted[i] = z[i] - kFiniteDiffEpsilon;
+        evaluate(function_name, x, shifted, f_minus, m);
+        for (size_t i = 0; i < m; i++)
+            grad_z[begin + i] = (f_plus[i] - f_minus[i]) / (2 * kFiniteDiffEpsilon);
+    }
+}
+}
+
+
+void evaluate(Function::FunctionName function_name,
+              const double* xs, const double* zs, double* out, size_t n){
+    if (function_name == Function::custom){
+        evaluate(*Surface::customExpression(), xs, zs, out, n);
+        return;
+    }
+    if (function_name == Function::heightmap){
+        evaluate(*Surface::heightmap(), xs, zs, out, n);
+        return;
+    }
+    size_t done = 0;
+    switch (BatchKernels::instructionSet()){
+    case BatchKernels::avx512:
+        done = evaluateAvx512(function_name, xs, zs, out, n);
+        break;
+    case BatchKernels::avx2:
+        done = evaluateAvx2(function_name, xs, zs, out, n);
+        break;
+    case BatchKernels::scalar:
+        break;
+    }
+    evaluateScalar(function_name, xs, zs, out, done, n);
+}
+
+
+void valueAndGradient(Function::FunctionName function_name,
+                      const double* xs, const double* zs,
+                      double* out, double* grad_x, double* grad_z, size_t n){
+    if (function_name == Function::custom){
+        valueAndGradient(*Surface::customExpression(), xs, zs, out, grad_x, grad_z, n);
+        return;
+    }
+    if (function_name == Function::heightmap){
+        valueAndGradient(*Surface::heightmap(), xs, zs, out, grad_x, grad_z, n);
+        return;
+    }
+    size_t done = 0;
+    switch (BatchKernels::instructionSet()){
+    case BatchKernels::avx512:
+        done = valueAndGradientAvx512(function_name, xs, zs, out, grad_x, grad_z, n);
+        break;
+    case BatchKernels::avx2:
+        done = valueAndGradientAvx2(function_name, xs, zs, out, grad_x, grad_z, n);
+        break;
+    case BatchKernels::scalar:
+        break;
+    }
+    valueAndGradientScalar(function_name, xs, zs, out, grad_x, grad_z, done, n);
+}
+
+
+void gradient(Function::FunctionName function_name, Gradient::GradientMethod method,
+              const double* xs, const double* zs,
+              double* grad_x, double* grad_z, size_t n){
+    if (method == Gradient::analytic)
+        valueAndGradient(function_name, xs, zs, nullptr, grad_x, grad_z, n);
+    else
+        finiteDifferenceGradient(function_name, xs, zs, grad_x, grad_z, n);
+}
+
+
+void evaluate(const Expression& expression,
+              const double* xs, const double* zs, double* out, size_t n){
+    double* outputs[] = {out};
+    runProgram(expression.valueProgram(), xs, zs, outputs, n);
+}
+
+
+void valueAndGradient(const Expression& expression,
+                      const double* xs, const double* zs,
+                      double* out, double* grad_x, double* grad_z, size_t n){
+    double* outputs[] = {out, grad_x, grad_z};
+    runProgram(expression.gradientProgram(), xs, zs, outputs, n);
+}
+
+
+void evaluate(const Heightmap& heightmap,
+              const double* xs, const double* zs, double* out, size_t n){
+    sampleHeightmap(heightmap, xs, zs, out, nullptr, nullptr, n);
+}
+
+
+void valueAndGradient(const Heightmap& heightmap,
+                      const double* xs, const double* zs,
+                      double* out, double* grad_x, double* grad_z, size_t n){
+    sampleHeightmap(heightmap, xs, zs, out, grad_x, grad_z, n);
+}
+
+
+void evaluateScalar(Function::FunctionName function_name,
+                    const double* xs, const double* zs, double* out,
+                    size_t begin, size_t end){
+    Evaluate visitor = {xs, zs, out, begin, end};
+    Surface::dispatch(function_name, visitor);
+}
+
+
+void valueAndGradientScalar(Function::FunctionName function_name,
+                            const double* xs, const double* zs,
+                            double* out, double* grad_x, double* grad_z,
+                            size_t begin, size_t end){
+    EvaluateWithGradient visitor = {xs, zs, out, grad_x, grad_z, begin, end};
+    Surface::dispatch(function_name, visitor);
+}
+
+
+
+void runProgramScalar(const ExpressionProgram& program, double* const* registers,
+                      size_t begin, size_t end){
+    for (const ExpressionProgram::Instruction& instruction : program.instructions){
+        const double* a = registers[instruction.a];
+        const double* b = registers[instruction.b];
+        double* out = registers[instruction.destination];
+        switch (instruction.op){
+        case ExpressionProgram::add:
+            for (size_t i = begin; i < end; i++) out[i] = a[i] + b[i];
+            break;
+        case ExpressionProgram::subtract:
+            for (size_t i = begin; i < end; i++) out[i] = a[i] - b[i];
+            break;
+        case ExpressionProgram::multiply:
+            for (size_t i = begin; i < end; i++) out[i] = a[i] * b[i];
+            break;
+        case ExpressionProgram::divide:
+            for (size_t i = begin; i < end; i++) out[i] = a[i] / b[i];
+            break;
+        case ExpressionProgram::negate:
+            for (size_t i = begin; i < end; i++) out[i] = -a[i];
+            break;
+        case ExpressionProgram::sqrt:
+            for (size_t i = begin; i < end; i++) out[i] = sqrt(a[i]);
+            break;
+        case ExpressionProgram::exp:
+            for (size_t i = begin; i < end; i++) out[i] = Surface::Math::exp(a[i]);
+            break;
+        case ExpressionProgram::sin:
+            for (size_t i = begin; i < end; i++) out[i] = Surface::Math::sin(a[i]);
+            break;
+        case ExpressionProgram::cos:
+            for (size_t i = begin; i < end; i++) out[i] = Surface::Math::cos(a[i]);
+            break;
+        }
+    }
+}
+
+
+
+void sampleHeightmapScalar(const Heightmap& heightmap, const double* xs, const double* zs,
+                           double* out, double* grad_x, double* grad_z,
+                           size_t begin, size_t end){
+    /* per point: the cell and the position in it, clamped to the grid, the
+     * weights of the 4 columns and 4 rows of samples around it, then the
+     * weighted sum of each row and of the rows. samples beyond the edge
+     * repeat the edge.
+     */
+    using Surface::Math::max;
+    using Surface::Math::min;
+    const float* values = heightmap.values();
+    const double width = double(heightmap.width());
+    const double last_x = width - 1.;
+    const double last_z = double(heightmap.height()) - 1.;
+    for (size_t i = begin; i < end; i++){
+        double fx = (xs[i] - kHeightmapMin) * heightmap.cellsPerX();
+        double fz = (zs[i] - kHeightmapMin) * heightmap.cellsPerZ();
+        double cx = min(max(fx, 0.), last_x);
+        double cz = min(max(fz, 0.), last_z);
+        double cell_x = min(floor(cx), last_x - 1.);
+        double cell_z = min(floor(cz), last_z - 1.);
+        double wx[4], dx[4], wz[4], dz[4];
+        catmullRomWeights(cx - cell_x, wx, dx);
+        catmullRomWeights(cz - cell_z, wz, dz);
+        double columns[4];
+        for (int j = 0; j < 4; j++)
+            columns[j] = min(max(cell_x + (j - 1.), 0.), last_x);
+
+        double value = 0., sum_dx = 0., sum_dz = 0.;
+        for (int k = 0; k < 4; k++){
+            double row = min(max(cell_z + (k - 1.), 0.), last_z) * width;
+            double p[4];
+            for (int j = 0; j < 4; j++) p[j] = values[size_t(row + columns[j])];
+            double s = wx[0] * p[0] + wx[1] * p[1] + wx[2] * p[2] + wx[3] * p[3];
+            value = k == 0 ? wz[0] * s : value + wz[k] * s;
+            if (grad_x == nullptr) continue;
+            double ds = dx[0] * p[0] + dx[1] * p[1] + dx[2] * p[2] + dx[3] * p[3];
+            sum_dx = k == 0 ? wz[0] * ds : sum_dx + wz[k] * ds;
+            sum_dz = k == 0 ? dz[0] * s : sum_dz + dz[k] * s;
+        }
+        if (out != nullptr) out[i] = value;
+        if (grad_x == nullptr) continue;
+        // no slope across the edge of the grid
+        grad_x[i] = fx == cx ? sum_dx * heightmap.cellsPerX() : 0.;
+        grad_z[i] = fz == cz ? sum_dz * heightmap.cellsPerZ() : 0.;
+    }
+}
+
+}
@@ -0,0 +1,359 @@
+// Vector kernels of SurfaceKernels. This file is included once per instruction
+// set by surface_kernels_x86.cpp, inside a namespace that defines the wrapper V:
+//   V::Reg, V::width, V::load, V::store, V::set1, V::sqrt, V::floor,
+//   V::max, V::min (the second operand if either is NaN),
+//   V::pow2 (2^k for integral k in [-1022, 1023]),
+//   V::gather (base[index] per lane, index integral and below 2^31),
+//   V::keepIfEqual (v where a == b, else 0),
+//   V::replaceIfGreater (replacement where a > b, else v)
+// The math is surface.h's (Surface::Math and the surface types), operation for
+// operation, so every lane gets the value the scalar kernel would.
+
+typedef V::Reg Reg;
+
+
+static Reg exp(Reg x){
+    using namespace Surface::Math;
+    const Reg unclamped = x;
+    x = V::min(V::set1(kExpMax), V::max(V::set1(kExpMin), x));
+    Reg k = V::floor(x * V::set1(kLog2e) + V::set1(0.5));
+    Reg r = x - k * V::set1(kLn2Hi);
+    r = r - k * V::set1(kLn2Lo);
+    Reg rr = r * r;
+    Reg p = r * ((V::set1(kExpP[0]) * rr + V::set1(kExpP[1])) * rr + V::set1(kExpP[2]));
+    Reg q = ((V::set1(kExpQ[0]) * rr + V::set1(kExpQ[1])) * rr + V::set1(kExpQ[2])) * rr
+            + V::set1(kExpQ[3]);
+    r = p / (q - p);
+    r = V::set1(1.) + V::set1(2.) * r;
+    return V::replaceIfGreater(unclamped, V::set1(kExpMax), r * V::pow2(k),
+                               V::set1(HUGE_VAL));
+}
+
+
+static Reg sinOrCos(Reg x, double shift){
+    using namespace Surface::Math;
+    const Reg one = V::set1(1.);
+    const Reg two = V::set1(2.);
+    Reg k = V::floor(x * V::set1(kTwoOverPi) + V::set1(0.5));
+    Reg r = x - k * V::set1(kPiOver2Hi);
+    r = r - k * V::set1(kPiOver2Mid);
+    r = r - k * V::set1(kPiOver2Lo);
+    Reg q = k + V::set1(shift);
+    q = q - V::set1(4.) * V::floor(q * V::set1(0.25));
+    Reg half_q = V::floor(q * V::set1(0.5));
+    Reg odd = q - two * half_q;
+    Reg sign = one - two * half_q;
+
+    Reg rr = r * r;
+    Reg sin_r = r + r * rr * (((((V::set1(kSinP[0]) * rr + V::set1(kSinP[1])) * rr
+                                 + V::set1(kSinP[2])) * rr + V::set1(kSinP[3])) * rr
+                               + V::set1(kSinP[4])) * rr + V::set1(kSinP[5]));
+    Reg cos_r = one - V::set1(0.5) * rr
+            + rr * rr * (((((V::set1(kCosP[0]) * rr + V::set1(kCosP[1])) * rr
+                            + V::set1(kCosP[2])) * rr + V::set1(kCosP[3])) * rr
+                          + V::set1(kCosP[4])) * rr + V::set1(kCosP[5]));
+    return sign * (sin_r * (one - odd) + cos_r * odd);
+}
+
+
+static Reg sin(Reg x){return sinOrCos(x, 0.);}
+static Reg cos(Reg x){return sinOrCos(x, 1.);}
+
+
+// the surfaces of surface.h on V::width points
+struct LocalMinimum {
+    static Reg f(Reg x, Reg z){
+        const Reg one = V::set1(1.);
+        z = z * V::set1(1.4);
+        return V::set1(-2.) * exp(-((x - one) * (x - one) + z * z) / V::set1(.2)) -
+                V::set1(6.) * exp(-((x + one) * (x + one) + z * z) / V::set1(.2)) +
+                x * x + z * z;
+    }
+
+    static Reg valueAndGradient(Reg x, Reg z, Reg& grad_x, Reg& grad_z){
+        const Reg one = V::set1(1.);
+        z = z * V::set1(1.4);
+        Reg e1 = exp(-((x - one) * (x - one) + z * z) / V::set1(.2));
+        Reg e2 = exp(-((x + one) * (x + one) + z * z) / V::set1(.2));
+        grad_x = V::set1(20.) * (x - one) * e1 + V::set1(60.) * (x + one) * e2
+                + V::set1(2.) * x;
+        grad_z = V::set1(1.4) * (V::set1(20.) * z * e1 + V::set1(60.) * z * e2
+                                 + V::set1(2.) * z);
+        return V::set1(-2.) * e1 - V::set1(6.) * e2 + x * x + z * z;
+    }
+};
+
+
+struct GlobalMinimum {
+    static Reg f(Reg x, Reg z){
+        return x * x + z * z;
+    }
+
+    static Reg valueAndGradient(Reg x, Reg z, Reg& grad_x, Reg& grad_z){
+        grad_x = V::set1(2.) * x;
+        grad_z = V::set1(2.) * z;
+        return x * x + z * z;
+    }
+};
+
+
+struct SaddlePoint {
+    static Reg f(Reg x, Reg z){
+        return sin(x) + z * z;
+    }
+
+    static Reg valueAndGradient(Reg x, Reg z, Reg& grad_x, Reg& grad_z){
+        grad_x = cos(x);
+        grad_z = V::set1(2.) * z;
+        return sin(x) + z * z;
+    }
+};
+
+
+struct EclipticBowl {
+    static Reg f(Reg x, Reg z){
+        x = x / V::set1(2.);
+        z = z / V::set1(2.);
+        return -exp(-(x * x + V::set1(5.) * z * z)) + x * x + V::set1(0.5) * z * z;
+    }
+
+    static Reg valueAndGradient(Reg x, Reg z, Reg& grad_x, Reg& grad_z){
+        x = x / V::set1(2.);
+        z = z / V::set1(2.);
+        Reg e = exp(-(x * x + V::set1(5.) * z * z));
+        grad_x = V::set1(0.5) * (V::set1(2.) * x * e + V::set1(2.) * x);
+        grad_z = V::set1(0.5) * (V::set1(10.) * z * e + z);
+        return -e + x * x + V::set1(0.5) * z * z;
+    }
+};
+
+
+struct Hills {
+    static Reg f(Reg x, Reg z){
+        const Reg one = V::set1(1.);
+        z = z * V::set1(1.4);
+        return  V::set1(2.) * exp(-((x - one) * (x - one) + z * z) / V::set1(.2)) +
+                V::set1(6.) * exp(-((x + one) * (x + one) + z * z) / V::set1(.2)) -
+                V::set1(2.) * exp(-((x - one) * (x - one) + (z + one) * (z + one))
+                                  / V::set1(.2)) +
+                x * x + z * z;
+    }
+
+    static Reg valueAndGradient(Reg x, Reg z, Reg& grad_x, Reg& grad_z){
+        const Reg one = V::set1(1.);
+        z = z * V::set1(1.4);
+        Reg e1 = exp(-((x - one) * (x - one) + z * z) / V::set1(.2));
+        Reg e2 = exp(-((x + one) * (x + one) + z * z) / V::set1(.2));
+        Reg e3 = exp(-((x - one) * (x - one) + (z + one) * (z + one)) / V::set1(.2));
+        grad_x = V::set1(-20.) * (x - one) * e1 - V::set1(60.) * (x + one) * e2
+                + V::set1(20.) * (x - one) * e3 + V::set1(2.) * x;
+        grad_z = V::set1(1.4) * (V::set1(-20.) * z * e1 - V::set1(60.) * z * e2
+                                 + V::set1(20.) * (z + one) * e3 + V::set1(2.) * z);
+        return V::set1(2.) * e1 + V::set1(6.) * e2 - V::set1(2.) * e3 + x * x + z * z;
+    }
+};
+
+
+struct Plateau {
+    static Reg f(Reg x, Reg z){
+        x = x * V::set1(10.);
+        z = z * V::set1(10.);
+        Reg r = V::sqrt(z * z + x * x) + V::set1(0.01);
+        return -sin(r) / r + V::set1(0.01) * r * r;
+    }
+
+    static Reg valueAndGradient(Reg x, Reg z, Reg& grad_x, Reg& grad_z){
+        x = x * V::set1(10.);
+        z = z * V::set1(10.);
+        Reg s = V::sqrt(z * z + x * x);
+        Reg r = s + V::set1(0.01);
+        Reg sin_r = sin(r);
+        Reg d_dr = -(cos(r) * r - sin_r) / (r * r) + V::set1(0.02) * r;
+        Reg s_nonzero = V::max(s, V::set1(DBL_MIN));
+        grad_x = V::set1(10.) * d_dr * x / s_nonzero;
+        grad_z = V::set1(10.) * d_dr * z / s_nonzero;
+        return -sin_r / r + V::set1(0.01) * r * r;
+    }
+};
+
+
+template <typename S>
+static size_t evaluate(const double* xs, const double* zs, double* out, size_t n){
+    n -= n % V::width;
+    for (size_t i = 0; i < n; i += V::width)
+        V::store(out + i, S::f(V::load(xs + i), V::load(zs + i)));
+    return n;
+}
+
+
+template <typename S>
+static size_t valueAndGradient(const double* xs, const double* zs,
+                               double* out, double* grad_x, double* grad_z, size_t n){
+    n -= n % V::width;
+    for (size_t i = 0; i < n; i += V::width){
+        Reg gx, gz;
+        Reg value = S::valueAndGradient(V::load(xs + i), V::load(zs + i), gx, gz);
+        if (out != nullptr) V::store(out + i, value);
+        V::store(grad_x + i, gx);
+        V::store(grad_z + i, gz);
+    }
+    return n;
+}
+
+
+static size_t evaluate(Function::FunctionName function_name,
+                       const double* xs, const double* zs, double* out, size_t n){
+    switch (function_name){
+    case Function::local_minimum: return evaluate<LocalMinimum>(xs, zs, out, n);
+    case Function::global_minimum: return evaluate<GlobalMinimum>(xs, zs, out, n);
+    case Function::saddle_point: return evaluate<SaddlePoint>(xs, zs, out, n);
+    case Function::ecliptic_bowl: return evaluate<EclipticBowl>(xs, zs, out, n);
+    case Function::hills: return evaluate<Hills>(xs, zs, out, n);
+    case Function::plateau: return evaluate<Plateau>(xs, zs, out, n);
+    case Function::custom: break;
+    case Function::heightmap: break;
+    }
+    return 0;
+}
+
+
+static size_t valueAndGradient(Function::FunctionName function_name,
+                               const double* xs, const double* zs,
+                               double* out, double* grad_x, double* grad_z, size_t n){
+    switch (function_name){
+    case Function::local_minimum:
+        return valueAndGradient<LocalMinimum>(xs, zs, out, grad_x, grad_z, n);
+    case Function::global_minimum:
+        return valueAndGradient<GlobalMinimum>(xs, zs, out, grad_x, grad_z, n);
+    case Function::saddle_point:
+        return valueAndGradient<SaddlePoint>(xs, zs, out, grad_x, grad_z, n);
+    case Function::ecliptic_bowl:
+        return valueAndGradient<EclipticBowl>(xs, zs, out, grad_x, grad_z, n);
+    case Function::hills:
+        return valueAndGradient<Hills>(xs, zs, out, grad_x, grad_z, n);
+    case Function::plateau:
+        return valueAndGradient<Plateau>(xs, zs, out, grad_x, grad_z, n);
+    case Function::custom:
+    case Function::heightmap:
+        break;
+    }
+    return 0;
+}
+
+
+static size_t runProgram(const ExpressionProgram& program, double* const* registers, size_t n){
+    n -= n % V::width;
+    for (const ExpressionProgram::Instruction& instruction : program.instructions){
+        const double* a = registers[instruction.a];
+        const double* b = registers[instruction.b];
+        double* out = registers[instruction.destination];
+        switch (instruction.op){
+        case ExpressionProgram::add:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, V::load(a + i) + V::load(b + i));
+            break;
+        case ExpressionProgram::subtract:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, V::load(a + i) - V::load(b + i));
+            break;
+        case ExpressionProgram::multiply:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, V::load(a + i) * V::load(b + i));
+            break;
+        case ExpressionProgram::divide:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, V::load(a + i) / V::load(b + i));
+            break;
+        case ExpressionProgram::negate:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, -V::load(a + i));
+            break;
+        case ExpressionProgram::sqrt:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, V::sqrt(V::load(a + i)));
+            break;
+        case ExpressionProgram::exp:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, exp(V::load(a + i)));
+            break;
+        case ExpressionProgram::sin:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, sin(V::load(a + i)));
+            break;
+        case ExpressionProgram::cos:
+            for (size_t i = 0; i < n; i += V::width)
+                V::store(out + i, cos(V::load(a + i)));
+            break;
+        }
+    }
+    return n;
+}
+
+
+static void catmullRomWeights(Reg t, Reg w[4], Reg d[4]){
+    w[0] = ((V::set1(-0.5) * t + V::set1(1.)) * t - V::set1(0.5)) * t;
+    w[1] = (V::set1(1.5) * t - V::set1(2.5)) * t * t + V::set1(1.);
+    w[2] = ((V::set1(-1.5) * t + V::set1(2.)) * t + V::set1(0.5)) * t;
+    w[3] = (V::set1(0.5) * t - V::set1(0.5)) * t * t;
+    d[0] = (V::set1(-1.5) * t + V::set1(2.)) * t - V::set1(0.5);
+    d[1] = (V::set1(4.5) * t - V::set1(5.)) * t;
+    d[2] = (V::set1(-4.5) * t + V::set1(4.)) * t + V::set1(0.5);
+    d[3] = (V::set1(1.5) * t - V::set1(1.)) * t;
+}
+
+
+// as sampleHeightmapScalar (surface_kernels.cpp)
+template <bool with_gradient>
+static size_t sampleHeightmap(const Heightmap& heightmap, const double* xs, const double* zs,
+                              double* out, double* grad_x, double* grad_z, size_t n){
+    n -= n % V::width;
+    const float* values = heightmap.values();
+    const Reg zero = V::set1(0.);
+    const Reg one = V::set1(1.);
+    const Reg width = V::set1(double(heightmap.width()));
+    const Reg last_x = V::set1(double(heightmap.width()) - 1.);
+    const Reg last_z = V::set1(double(heightmap.height()) - 1.);
+    const Reg cells_per_x = V::set1(heightmap.cellsPerX());
+    const Reg cells_per_z = V::set1(heightmap.cellsPerZ());
+    const Reg min_coordinate = V::set1(kHeightmapMin);
+    for (size_t i = 0; i < n; i += V::width){
+        Reg fx = (V::load(xs + i) - min_coordinate) * cells_per_x;
+        Reg fz = (V::load(zs + i) - min_coordinate) * cells_per_z;
+        Reg cx = V::min(V::max(fx, zero), last_x);
+        Reg cz = V::min(V::max(fz, zero), last_z);
+        Reg cell_x = V::min(V::floor(cx), last_x - one);
+        Reg cell_z = V::min(V::floor(cz), last_z - one);
+        Reg wx[4], dx[4], wz[4], dz[4];
+        catmullRomWeights(cx - cell_x, wx, dx);
+        catmullRomWeights(cz - cell_z, wz, dz);
+        Reg columns[4];
+        for (int j = 0; j < 4; j++)
+            columns[j] = V::min(V::max(cell_x + V::set1(j - 1.), zero), last_x);
+
+        Reg value = zero, sum_dx = zero, sum_dz = zero;
+        for (int k = 0; k < 4; k++){
+            Reg row = V::min(V::max(cell_z + V::set1(k - 1.), zero), last_z) * width;
+            Reg p[4];
+            for (int j = 0; j < 4; j++) p[j] = V::gather(values, row + columns[j]);
+            Reg s = wx[0] * p[0] + wx[1] * p[1] + wx[2] * p[2] + wx[3] * p[3];
+            value = k == 0 ? wz[0] * s : value + wz[k] * s;
+            if (!with_gradient) continue;
+            Reg ds = dx[0] * p[0] + dx[1] * p[1] + dx[2] * p[2] + dx[3] * p[3];
+            sum_dx = k == 0 ? wz[0] * ds : sum_dx + wz[k] * ds;
+            sum_dz = k == 0 ? dz[0] * s : sum_dz + dz[k] * s;
+        }
+        if (out != nullptr) V::store(out + i, value);
+        if (!with_gradient) continue;
+        V::store(grad_x + i, V::keepIfEqual(fx, cx, sum_dx * cells_per_x));
+        V::store(grad_z + i, V::keepIfEqual(fz, cz, sum_dz * cells_per_z));
+    }
+    return n;
+}
+
+
+static size_t sampleHeightmap(const Heightmap& heightmap, const double* xs, const double* zs,
+                              double* out, double* grad_x, double* grad_z, size_t n){
+    if (grad_x == nullptr)
+        return sampleHeightmap<false>(heightmap, xs, zs, out, nullptr, nullptr, n);
+    return sampleHeightmap<true>(heightmap, xs, zs, out, grad_x, grad_z, n);
+}
@@ -0,0 +1,207 @@
+#include "surface_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SURFACE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// Each instruction set gets its own copy of the kernels, compiled for that
+// target only. Nothing in this file may be called unless
+// BatchKernels::detectInstructionSet() reports the matching instruction set.
+
+namespace SurfaceKernels{
+
+#ifdef SURFACE_KERNELS_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace avx2_kernels{
+struct V {
+    typedef __m256d Reg;
+    static const size_t width = 4;
+
+    static Reg load(const double* p){return _mm256_loadu_pd(p);}
+    static void store(double* p, Reg v){_mm256_storeu_pd(p, v);}
+    static Reg set1(double value){return _mm256_set1_pd(value);}
+    static Reg sqrt(Reg v){return _mm256_sqrt_pd(v);}
+    static Reg floor(Reg v){return _mm256_floor_pd(v);}
+    static Reg max(Reg a, Reg b){return _mm256_max_pd(a, b);}
+    static Reg min(Reg a, Reg b){return _mm256_min_pd(a, b);}
+    static Reg pow2(Reg k){
+        __m256i bits = _mm256_castpd_si256(k + set1(Surface::Math::kPow2Bias));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+    }
+    static Reg gather(const float* base, Reg index){
+        return _mm256_cvtps_pd(_mm_i32gather_ps(base, _mm256_cvttpd_epi32(index), 4));
+    }
+    static Reg keepIfEqual(Reg a, Reg b, Reg v){
+        return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ), v);
+    }
+    static Reg replaceIfGreater(Reg a, Reg b, Reg v, Reg replacement){
+        return _mm256_blendv_pd(v, replacement, _mm256_cmp_pd(a, b, _CMP_GT_OQ));
+    }
+};
+
+#include "surface_kernels_simd.inl"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// avx-512 implies fma; keep mul and add separate so results match the scalar
+// kernel. clang ignores this; the .pro files pass it -ffp-contract=off.
+#pragma GCC optimize("fp-contract=off")
+#endif
+namespace avx512_kernels{
+struct V {
+    typedef __m512d Reg;
+    static const size_t width = 8;
+    static const __mmask8 kAll = 0xff;
+
+    /* the unmasked intrinsics pass gcc an undefined source operand, which it
+     * warns about; the full-mask forms take a defined one and compile the same
+     */
+    static Reg load(const double* p){return _mm512_loadu_pd(p);}
+    static void store(double* p, Reg v){_mm512_storeu_pd(p, v);}
+    static Reg set1(double value){return _mm512_set1_pd(value);}
+    static Reg sqrt(Reg v){return _mm512_mask_sqrt_pd(v, kAll, v);}
+    static Reg floor(Reg v){
+        return _mm512_mask_roundscale_pd(v, kAll, v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    }
+    static Reg max(Reg a, Reg b){return _mm512_mask_max_pd(a, kAll, a, b);}
+    static Reg min(Reg a, Reg b){return _mm512_mask_min_pd(a, kAll, a, b);}
+    static Reg pow2(Reg k){
+        __m512i bits = _mm512_castpd_si512(k + set1(Surface::Math::kPow2Bias));
+        return _mm512_castsi512_pd(_mm512_mask_slli_epi64(bits, kAll, bits, 52));
+    }
+    static Reg gather(const float* base, Reg index){
+        __m256i indices = _mm512_mask_cvttpd_epi32(_mm256_setzero_si256(), kAll, index);
+        return _mm512_mask_cvtps_pd(_mm512_setzero_pd(), kAll,
+                                    _mm256_i32gather_ps(base, indices, 4));
+    }
+    static Reg keepIfEqual(Reg a, Reg b, Reg v){
+        return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ), v);
+    }
+    static Reg replaceIfGreater(Reg a, Reg b, Reg v, Reg replacement){
+        return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ), v, replacement);
+    }
+};
+
+#include "surface_kernels_simd.inl"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+
+size_t evaluateAvx2(Function::FunctionName function_name,
+                    const double* xs, const double* zs, double* out, size_t n){
+    return avx2_kernels::evaluate(function_name, xs, zs, out, n);
+}
+
+
+size_t evaluateAvx512(Function::FunctionName function_name,
+                      const double* xs, const double* zs, double* out, size_t n){
+    return avx512_kernels::evaluate(function_name, xs, zs, out, n);
+}
+
+
+size_t valueAndGradientAvx2(Function::FunctionName function_name,
+                            const double* xs, const double* zs,
+                            double* out, double* grad_x, double* grad_z, size_t n){
+    return avx2_kernels::valueAndGradient(function_name, xs, zs, out, grad_x, grad_z, n);
+}
+
+
+size_t valueAndGradientAvx512(Function::FunctionName function_name,
+                              const double* xs, const double* zs,
+                              double* out, double* grad_x, double* grad_z, size_t n){
+    return avx512_kernels::valueAndGradient(function_name, xs, zs, out, grad_x, grad_z, n);
+}
+
+
+size_t runProgramAvx2(const ExpressionProgram& program, double* const* registers, size_t n){
+    return avx2_kernels::runProgram(program, registers, n);
+}
+
+
+size_t runProgramAvx512(const ExpressionProgram& program, double* const* registers, size_t n){
+    return avx512_kernels::runProgram(program, registers, n);
+}
+
+
+size_t sampleHeightmapAvx2(const Heightmap& heightmap, const double* xs, const double* zs,
+                           double* out, double* grad_x, double* grad_z, size_t n){
+    return avx2_kernels::sampleHeightmap(heightmap, xs, zs, out, grad_x, grad_z, n);
+}
+
+
+size_t sampleHeightmapAvx512(const Heightmap& heightmap, const double* xs, const double* zs,
+                             double* out, double* grad_x, double* grad_z, size_t n){
+    return avx512_kernels::sampleHeightmap(heightmap, xs, zs, out, grad_x, grad_z, n);
+}
+
+#else
+
+// no vector kernels for this compiler / architecture; the scalar kernels
+// handle every point.
+size_t evaluateAvx2(Function::FunctionName, const double*, const double*, double*, size_t){
+    return 0;
+}
+
+
+size_t evaluateAvx512(Function::FunctionName, const double*, const double*, double*, size_t){
+    return 0;
+}
+
+
+size_t valueAndGradientAvx2(Function::FunctionName, const double*, const double*,
+                            double*, double*, double*, size_t){
+    return 0;
+}
+
+
+size_t valueAndGradientAvx512(Function::FunctionName, const double*, const double*,
+                              double*, double*, double*, size_t){
+    return 0;
+}
+
+
+size_t runProgramAvx2(const ExpressionProgram&, double* const*, size_t){
+    return 0;
+}
+
+
+size_t runProgramAvx512(const ExpressionProgram&, double* const*, size_t){
+    return 0;
+}
+
+
+size_t sampleHeightmapAvx2(const Heightmap&, const double*, const double*,
+                           double*, double*, double*, size_t){
+    return 0;
+}
+
+
+size_t sampleHeightmapAvx512(const Heightmap&, const double*, const double*,
+                             double*, double*, double*, size_t){
+    return 0;
+}
+
+#endif
+
+}
@@ -0,0 +1,145 @@
+#include "sweep.h"
+#include "batch_descent.h"
+#include "thread_pool.h"
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+
+namespace {
+
+typedef double Hyperparameters::*Field;
+
+struct Axis {
+    Field field;
+    const std::vector<double>* values;
+};
+
+
+std::vector<Axis> axes(const SweepSpace& space){
+    std::vector<Axis> result = {
+        {&Hyperparameters::learning_rate, &space.learning_rates},
+        {&Hyperparameters::decay_rate, &space.decay_rates},
+        {&Hyperparameters::discount_factor, &space.discount_factors},
+        {&Hyperparameters::squared_discount_factor, &space.squared_discount_factors},
+        {&Hyperparameters::beta1, &space.beta1s},
+        {&Hyperparameters::beta2, &space.beta2s},
+    };
+    return result;
+}
+
+
+std::vector<Function::FunctionName> functionNames(const SweepSpace& space,
+                                                  const SweepConfiguration& base){
+    if (space.function_names.empty())
+        return std::vector<Function::FunctionName>(1, base.function_name);
+    return space.function_names;
+}
+
+
+SweepResult runConfiguration(Optimizer::OptimizerName optimizer_name,
+                             const SweepConfiguration& configuration,
+                             const std::vector<Point>& starting_points,
+                             int max_steps){
+    auto start_time = std::chrono::steady_clock::now();
+
+    BatchGradientDescent descent(optimizer_name, configuration.hyperparameters);
+    descent.function_name = configuration.function_name;
+    descent.setStartingPositions(starting_points);
+    for (int step = 0; step < max_steps; step++){
+        if (descent.numConverged() == descent.size()) break;
+        descent.takeGradientSteps();
+    }
+
+    SweepResult result;
+    result.configuration = configuration;
+    result.num_converged = descent.numConverged();
+    if (result.num_converged == descent.size()){
+        result.steps_to_converge = 0;
+        for (int steps : descent.batchState().num_steps)
+            result.steps_to_converge = std::max(result.steps_to_converge, steps);
+    }
+    for (double loss : descent.losses())
+        result.final_loss += loss;
+    if (descent.size() > 0) result.final_loss /= descent.size();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    result.wall_time = elapsed.count();
+    return result;
+}
+
+}
+
+
+std::vector<SweepConfiguration> Sweep::grid(const SweepSpace& space,
+                                            const SweepConfiguration& base){
+    std::vector<SweepConfiguration> configurations;
+    for (Function::FunctionName function_name : functionNames(space, base)){
+        configurations.push_back(base);
+        configurations.back().function_name = function_name;
+    }
+    // multiply out one hyperparameter at a time
+    for (const Axis& axis : axes(space)){
+        if (axis.values->empty()) continue;
+        std::vector<SweepConfiguration> expanded;
+        for (const SweepConfiguration& configuration : configurations){
+            for (double value : *axis.values){
+                expanded.push_back(configuration);
+                expanded.back().hyperparameters.*axis.field = value;
+            }
+        }
+        configurations.swap(expanded);
+    }
+    return configurations;
+}
+
+
+std::vector<SweepConfiguration> Sweep::random(const SweepSpace& space,
+                                              const SweepConfiguration& base,
+                                              int num_samples, unsigned seed){
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::vector<Function::FunctionName> function_names = functionNames(space, base);
+    std::vector<Axis> all_axes = axes(space);
+
+    std::vector<SweepConfiguration> configurations;
+    for (int n = 0; n < num_samples; n++){
+        SweepConfiguration configuration = base;
+        configuration.function_name =
+                function_names[std::min(size_t(uniform(generator) * function_names.size()),
+                                        function_names.size() - 1)];
+        for (const Axis& axis : all_axes){
+            if (axis.values->empty()) continue;
+            double low = *std::min_element(axis.values->begin(), axis.values->end());
+            double high = *std::max_element(axis.values->begin(), axis.values->end());
+            double t = uniform(generator);
+            // learning rates span orders of magnitude; sample their exponent
+            double value = axis.field == &Hyperparameters::learning_rate && low > 0 ?
+                        exp(log(low) + t * (log(high) - log(low))) :
+                        low + t * (high - low);
+            configuration.hyperparameters.*axis.field = value;
+        }
+        configurations.push_back(configuration);
+    }
+    return configurations;
+}
+
+
+std::vector<SweepResult> Sweep::run(Optimizer::OptimizerName optimizer_name,
+                                    const std::vector<SweepConfiguration>& configurations,
+                                    const std::vector<Point>& starting_points,
+                                    int max_steps, ThreadPool& pool){
+    /* one task per configuration. runs that converge quickly free their
+     * worker early and it steals the next waiting configuration, so no core
+     * sits idle while another works through a long queue.
+     */
+    std::vector<SweepResult> results(configurations.size());
+    pool.parallelFor(configurations.size(), 1, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++)
+            results[i] = runConfiguration(optimizer_name, configurations[i],
+                                          starting_points, max_steps);
+    });
+    return results;
+}
@@ -0,0 +1,158 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+// which pool and queue the current thread works for
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_queue = -1;
+}
+
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_pending(0),
+      num_queued(0),
+      next_queue(0)
+{
+    if (num_threads <= 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < num_threads; i++)
+        queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue));
+    for (int i = 0; i < num_threads; i++)
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+
+ThreadPool::~ThreadPool(){
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake_workers.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+
+int ThreadPool::currentQueue() const{
+    return current_pool == this ? current_queue : -1;
+}
+
+
+void ThreadPool::submit(std::function<void()> task){
+    int queue_index = currentQueue();
+    if (queue_index < 0)
+        queue_index = next_queue.fetch_add(1) % queues.size();
+
+    num_pending++;
+    {
+        std::lock_guard<std::mutex> lock(queues[queue_index]->mutex);
+        queues[queue_index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        num_queued++;
+    }
+    wake_workers.notify_one();
+}
+
+
+bool ThreadPool::popOrSteal(int queue_index, std::function<void()>& task){
+    const int num_queues = int(queues.size());
+    // own queue first, newest task first
+    if (queue_index >= 0){
+        TaskQueue& own = *queues[queue_index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()){
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            num_queued--;
+            return true;
+        }
+    }
+    // then the oldest task of someone else
+    int start = queue_index >= 0 ? queue_index + 1 : 0;
+    for (int i = 0; i < num_queues; i++){
+        TaskQueue& victim = *queues[(start + i) % num_queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            num_queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ThreadPool::runTask(std::function<void()>& task){
+    task();
+    task = nullptr;
+    if (--num_pending == 0){
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        all_done.notify_all();
+    }
+}
+
+
+void ThreadPool::workerLoop(int queue_index){
+    current_pool = this;
+    current_queue = queue_index;
+    std::function<void()> task;
+    while (true){
+        if (popOrSteal(queue_index, task)){
+            runTask(task);
+            continue;
+        }
+        // a task submitted since the search above has already raised
+        // num_queued, or will under this lock and then notify
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake_workers.wait(lock, [this]{return stopping || num_queued > 0;});
+        if (stopping) return;
+    }
+}
+
+
+void ThreadPool::wait(){
+    // help out instead of just blocking. once no task is left to take, the
+    // rest are running on workers, and the last to finish wakes us.
+    std::function<void()> task;
+    while (num_pending > 0){
+        if (popOrSteal(currentQueue(), task)){
+            runTask(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        all_done.wait(lock, [this]{return num_pending == 0;});
+    }
+}
+
+
+void ThreadPool::parallelFor(size_t size, size_t grain,
+                             const std::function<void(size_t, size_t)>& body){
+    grain = std::max<size_t>(grain, 1);
+    std::atomic<size_t> remaining(size);
+    for (size_t begin = 0; begin < size; begin += grain){
+        size_t end = std::min(size, begin + grain);
+        submit([this, &body, &remaining, begin, end](){
+            body(begin, end);
+            // remaining may be gone once it reaches 0; don't touch it after
+            if ((remaining -= end - begin) == 0){
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                all_done.notify_all();
+            }
+        });
+    }
+    // only wait for our own ranges, not for unrelated tasks in the pool. once
+    // none is left to take, the rest are running on workers.
+    std::function<void()> task;
+    while (remaining > 0){
+        if (popOrSteal(currentQueue(), task)){
+            runTask(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        all_done.wait(lock, [&remaining]{return remaining == 0;});
+    }
+}
@@ -0,0 +1,62 @@
+#include "timeline.h"
+
+#include <algorithm>
+
+
+Timeline::Timeline(int checkpoint_interval)
+    : checkpoint_interval(checkpoint_interval),
+      current_step(0),
+      m_length(0)
+{}
+
+
+void Timeline::start(GradientDescent& descent){
+    checkpoints.clear();
+    checkpoints.push_back(descent.saveState());
+    changes.clear();
+    recorded_version = descent.hyperparametersVersion();
+    record_next_hyperparameters = false;
+    current_step = 0;
+    m_length = 0;
+}
+
+
+void Timeline::recordStep(GradientDescent& descent){
+    int step = ++current_step;
+    m_length = step;
+    // drop checkpoints past this step, left over from before a seek back
+    size_t num_valid = (step + checkpoint_interval - 1) / checkpoint_interval;
+    if (checkpoints.size() > num_valid) checkpoints.resize(num_valid);
+    while (!changes.empty() && changes.back().step >= step) changes.pop_back();
+    if (record_next_hyperparameters || descent.hyperparametersVersion() != recorded_version){
+        changes.push_back(HyperparameterChange{step, descent.hyperparameters()});
+        recorded_version = descent.hyperparametersVersion();
+        record_next_hyperparameters = false;
+    }
+    if (step % checkpoint_interval == 0)
+        checkpoints.push_back(descent.saveState());
+}
+
+
+void Timeline::seek(GradientDescent& descent, int step){
+    step = std::max(0, std::min(step, int(m_length)));
+    int checkpoint = step / checkpoint_interval;
+    int first = checkpoint * checkpoint_interval;
+    Hyperparameters live = descent.hyperparameters();
+    // the checkpoint brings the set in use at its step
+    descent.restoreState(checkpoints[checkpoint]);
+    auto change = std::upper_bound(changes.begin(), changes.end(), first,
+                                   [](int step, const HyperparameterChange& change){
+        return step < change.step;
+    });
+    for (int i = first; i < step; i++){
+        if (change != changes.end() && change->step == i + 1){
+            descent.restoreHyperparameters(change->params);
+            ++change;
+        }
+        descent.replayGradientStep();
+    }
+    descent.restoreHyperparameters(live);
+    record_next_hyperparameters = true;
+    current_step = step;
+}
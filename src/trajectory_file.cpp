@@ -0,0 +1,145 @@
+#include "trajectory_file.h"
+
+#include <stddef.h>
+
+const size_t kTrajectoryBufferSize = 1 << 20;
+
+
+TrajectoryHeader TrajectoryHeader::create(Function::FunctionName function_name,
+                                          Optimizer::OptimizerName optimizer_name,
+                                          const Hyperparameters& hyperparameters,
+                                          size_t num_trajectories, int step_interval){
+    TrajectoryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kTrajectoryMagic, sizeof(header.magic));
+    header.version = kTrajectoryVersion;
+    header.function_name = function_name;
+    header.optimizer_name = optimizer_name;
+    header.gradient_method = GradientDescent::gradient_method;
+    header.use_bias_correction = hyperparameters.use_bias_correction;
+    header.step_interval = step_interval;
+    header.num_trajectories = num_trajectories;
+    header.learning_rate = hyperparameters.learning_rate;
+    header.decay_rate = hyperparameters.decay_rate;
+    header.discount_factor = hyperparameters.discount_factor;
+    header.squared_discount_factor = hyperparameters.squared_discount_factor;
+    header.beta1 = hyperparameters.beta1;
+    header.beta2 = hyperparameters.beta2;
+    return header;
+}
+
+
+Hyperparameters TrajectoryHeader::hyperparameters() const{
+    Hyperparameters h;
+    h.learning_rate = learning_rate;
+    h.decay_rate = decay_rate;
+    h.discount_factor = discount_factor;
+    h.squared_discount_factor = squared_discount_factor;
+    h.beta1 = beta1;
+    h.beta2 = beta2;
+    h.use_bias_correction = use_bias_correction != 0;
+    return h;
+}
+
+
+bool TrajectoryWriter::open(const std::string& path, const TrajectoryHeader& header,
+                            const std::vector<Point>& starting_points){
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    failed = false;
+    buffer.resize(kTrajectoryBufferSize);
+    buffer_used = 0;
+    last_step = 0;
+
+    write(&header, sizeof(header));
+    last_x.clear();
+    last_z.clear();
+    for (const Point& p : starting_points){
+        write(&p.x, sizeof(double));
+        write(&p.z, sizeof(double));
+        last_x.push_back(p.x);
+        last_z.push_back(p.z);
+    }
+    return !failed;
+}
+
+
+void TrajectoryWriter::append(const double* x, const double* z, uint64_t step){
+    last_step = step;
+    for (size_t i = 0; i < last_x.size(); i++){
+        TrajectoryDelta delta;
+        delta.dx = float(x[i] - last_x[i]);
+        delta.dz = float(z[i] - last_z[i]);
+        // follow the reader's arithmetic exactly
+        last_x[i] += delta.dx;
+        last_z[i] += delta.dz;
+        write(&delta, sizeof(delta));
+    }
+}
+
+
+void TrajectoryWriter::write(const void* data, size_t size){
+    if (buffer_used + size > buffer.size()) flush();
+    memcpy(buffer.data() + buffer_used, data, size);
+    buffer_used += size;
+}
+
+
+void TrajectoryWriter::flush(){
+    if (buffer_used > 0 && fwrite(buffer.data(), 1, buffer_used, file) != buffer_used)
+        failed = true;
+    buffer_used = 0;
+}
+
+
+bool TrajectoryWriter::close(){
+    if (file == nullptr) return !failed;
+    flush();
+    if (fseek(file, offsetof(TrajectoryHeader, num_steps), SEEK_SET) != 0 ||
+        fwrite(&last_step, sizeof(last_step), 1, file) != 1)
+        failed = true;
+    if (fclose(file) != 0) failed = true;
+    file = nullptr;
+    return !failed;
+}
+
+
+bool TrajectoryReader::open(const std::string& path){
+    records = starting_points = nullptr;
+    num_records = 0;
+    if (!file.open(path) || file.size() < sizeof(TrajectoryHeader)) return false;
+    memcpy(&m_header, file.data(), sizeof(m_header));
+    if (memcmp(m_header.magic, kTrajectoryMagic, sizeof(kTrajectoryMagic)) != 0 ||
+        m_header.version != kTrajectoryVersion ||
+        m_header.function_name > Function::plateau ||
+        m_header.optimizer_name >= uint32_t(Optimizer::kNumOptimizers) ||
+        m_header.num_trajectories == 0 || m_header.step_interval == 0)
+        return false;
+
+    /* the counts come from the file; bound them by its size before
+     * multiplying, so a corrupt header can't overflow the sizes below
+     */
+    const size_t available = file.size() - sizeof(TrajectoryHeader);
+    if (m_header.num_trajectories > available / (2 * sizeof(double))) return false;
+    size_t points_size = numTrajectories() * 2 * sizeof(double);
+    starting_points = file.data() + sizeof(TrajectoryHeader);
+    records = starting_points + points_size;
+    size_t record_size = numTrajectories() * sizeof(TrajectoryDelta);
+    num_records = (available - points_size) / record_size;
+    return true;
+}
+
+
+uint64_t TrajectoryReader::step(uint64_t record) const{
+    if (record > 0 && record == num_records && m_header.num_steps != 0)
+        return m_header.num_steps;
+    return record * m_header.step_interval;
+}
+
+
+Point TrajectoryReader::startingPoint(size_t trajectory) const{
+    double xz[2];
+    memcpy(xz, starting_points + trajectory * sizeof(xz), sizeof(xz));
+    return Point(xz[0], xz[1]);
+}
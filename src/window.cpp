@@ -28,11 +28,13 @@ Window::Window(QWidget *parent)
     // things on the left
     hLayout->addLayout(vLayoutLeft);
     vLayoutLeft->addWidget(graph_container, 1);
+    vLayoutLeft->addWidget(createTimelineGroup());
     vLayoutLeft->addWidget(createControlGroup());
     hLayout->addLayout(vLayout);
 
     // things on the right
     vLayout->addWidget(createFunctionSelector());
+    vLayout->addLayout(createCustomSurfaceBox());
     vLayout->addWidget(createViewTabs());
     // widgets to tune gradient parameters
     vLayout->addWidget(createGradientDescentGroup());
@@ -70,8 +72,12 @@ QGroupBox *Window::createControlGroup(){
 
     layout->addWidget(createToggleAnimationButton());
     layout->addWidget(createRestartAnimationButton());
+    layout->addWidget(createLoadTrajectoryButton());
+    layout->addWidget(createLoadHeightmapButton());
     layout->addWidget(new QLabel(QStringLiteral("Playback speed:")));
     layout->addWidget(createPlaybackSpeedBox());
+    layout->addWidget(new QLabel(QStringLiteral("Mesh:")));
+    layout->addWidget(createSurfaceResolutionBox());
     layout->addWidget(createZoomButton(1));
     layout->addWidget(createZoomButton(0));
 
@@ -81,6 +87,37 @@ QGroupBox *Window::createControlGroup(){
 }
 
 
+QGroupBox *Window::createTimelineGroup(){
+    // drag to go back (or forward again) to any step of the current run
+    QGroupBox *groupBox = new QGroupBox();
+    QHBoxLayout *layout = new QHBoxLayout;
+    groupBox->setLayout(layout);
+
+    QSlider *slider = new QSlider(Qt::Horizontal);
+    slider->setRange(0, 0);
+    QLabel *stepLabel = new QLabel(QStringLiteral("Step 0"));
+    stepLabel->setMinimumWidth(100);
+    layout->addWidget(slider, 1);
+    layout->addWidget(stepLabel);
+
+    QObject::connect(slider, &QSlider::valueChanged, plot_area, &PlotArea::seekTimeline);
+    QObject::connect(slider, &QSlider::valueChanged,
+                     [=](int step){stepLabel->setText(QString("Step %1").arg(step));});
+    QObject::connect(plot_area, &PlotArea::timelineChanged,
+        [=](int step, int length){
+            stepLabel->setText(QString("Step %1").arg(step));
+            // don't fight the user while they drag
+            if (slider->isSliderDown()) return;
+            const QSignalBlocker blocker(slider);
+            slider->setRange(0, length);
+            slider->setValue(step);
+        });
+
+    groupBox->setFocusPolicy(Qt::NoFocus);
+    return groupBox;
+}
+
+
 QPushButton *Window::createZoomButton(int is_zoomout){
     // is_zoomout: 1 for zoomout; 0 for zoom in.
     QPushButton* zoom = new QPushButton();
@@ -133,6 +170,39 @@ QPushButton *Window::createRestartAnimationButton(){
 }
 
 
+QPushButton *Window::createLoadTrajectoryButton(){
+    // show runs recorded by the command line runner (--binary-trajectory)
+    QPushButton *loadButton = new QPushButton(this);
+    loadButton->setText(QStringLiteral("Load Run..."));
+    QObject::connect(loadButton, &QPushButton::clicked, [=](){
+        QString path = QFileDialog::getOpenFileName(this, QStringLiteral("Load Run"));
+        if (path.isEmpty()) return;
+        if (!plot_area->loadTrajectory(path))
+            QMessageBox::warning(this, QStringLiteral("Load Run"),
+                                 QString("%1 is not a trajectory file.").arg(path));
+    });
+    return loadButton;
+}
+
+
+QPushButton *Window::createLoadHeightmapButton(){
+    // a loss landscape computed elsewhere, as an image or a raw float32 grid
+    QPushButton *loadButton = new QPushButton(this);
+    loadButton->setText(QStringLiteral("Load Heightmap..."));
+    QObject::connect(loadButton, &QPushButton::clicked, [=](){
+        QString path = QFileDialog::getOpenFileName(
+                    this, QStringLiteral("Load Heightmap"), QString(),
+                    QStringLiteral("Heightmaps (*.png *.jpg *.bmp *.pgm *.f32 *.raw *.bin);;"
+                                   "All files (*)"));
+        if (path.isEmpty()) return;
+        QString error;
+        if (!plot_area->loadHeightmap(path, error))
+            QMessageBox::warning(this, QStringLiteral("Load Heightmap"), error);
+    });
+    return loadButton;
+}
+
+
 QComboBox *Window::createPlaybackSpeedBox(){
     QComboBox *box = new QComboBox(this);
     box->addItem("0.1x");
@@ -148,6 +218,21 @@ QComboBox *Window::createPlaybackSpeedBox(){
 }
 
 
+QComboBox *Window::createSurfaceResolutionBox(){
+    QComboBox *box = new QComboBox(this);
+    box->setToolTip("Points per side of the surface mesh. Use the finer ones for\n"
+                    "screenshots; every mesh is computed once and then kept.");
+    box->addItem("51 x 51");
+    box->addItem("101 x 101");
+    box->addItem("256 x 256");
+    box->addItem("1024 x 1024");
+
+    QObject::connect(box, SIGNAL(currentIndexChanged(int)),
+                     plot_area, SLOT(setSurfaceResolution(int)));
+    return box;
+}
+
+
 QComboBox *Window::createFunctionSelector(){
     QComboBox *box = new QComboBox(this);
     box->addItem("--Choose a surface--");
@@ -157,13 +242,43 @@ QComboBox *Window::createFunctionSelector(){
     box->addItem("Ecliptic Bowl");
     box->addItem("Hills");
     box->addItem("Plateau");
+    box->addItem("Custom");
+    box->addItem("Heightmap");
 
     QObject::connect(box, SIGNAL(currentIndexChanged(QString)),
                      plot_area, SLOT(changeSurface(QString)));
+    // the items are in the order of Function::FunctionName
+    QObject::connect(plot_area, &PlotArea::surfaceChanged,
+        [=](Function::FunctionName function_name){
+            const QSignalBlocker blocker(box);
+            box->setCurrentIndex(function_name + 1);
+        });
     return box;
 }
 
 
+QLayout* Window::createCustomSurfaceBox(){
+    QLineEdit* edit = new QLineEdit(
+            QString::fromStdString(Surface::customExpression()->text()));
+    edit->setToolTip(QStringLiteral(
+            "The Custom surface, e.g. x^2 + z^2 + sin(3*x) * sin(3*z)\n"
+            "Numbers, x, z, pi, e, + - * / ^ (whole exponents), parentheses,\n"
+            "sqrt, exp, sin and cos. Press Enter to use it."));
+    QLabel* message = new QLabel;
+    message->setWordWrap(true);
+
+    QObject::connect(edit, &QLineEdit::returnPressed,
+                     [=](){plot_area->setCustomSurface(edit->text());});
+    QObject::connect(plot_area, &PlotArea::updateCustomSurfaceMessage,
+                     message, &QLabel::setText);
+
+    QFormLayout* layout = new QFormLayout;
+    layout->addRow(new QLabel(QStringLiteral("Custom:")), edit);
+    layout->addRow(message);
+    return layout;
+}
+
+
 QGroupBox *Window::createDescentGroup(Animation* animation,
                                       QFormLayout* layout){
     QGroupBox *groupBox = new QGroupBox(animation->name);
@@ -202,7 +317,7 @@ QGroupBox *Window::createMomentumGroup(){
     form->addRow(new QLabel(QStringLiteral("Learning Rate:")),
                  createLearningRateBox(descent));
     form->addRow(new QLabel(QStringLiteral("Decay rate:")),
-                 createDecayBox(descent->decay_rate));
+                 createDecayBox(descent, &Hyperparameters::decay_rate));
 
     return createDescentGroup(plot_area->momentum.get(), form);
 }
@@ -217,10 +332,10 @@ QGroupBox *Window::createQHMGroup()
             createLearningRateBox( descent ) );
     form->addRow(
             new QLabel( QStringLiteral( "Decay rate:" ) ),
-            createDecayBox( descent->decay_rate ) );
+            createDecayBox( descent, &Hyperparameters::decay_rate ) );
     form->addRow(
             new QLabel( QStringLiteral( "Discount factor:" ) ),
-            createDecayBox( descent->discount_factor ) );
+            createDecayBox( descent, &Hyperparameters::discount_factor ) );
 
     return createDescentGroup( plot_area->qhm.get(), form );
 }
@@ -243,7 +358,7 @@ QGroupBox *Window::createRMSPropGroup(){
     form->addRow(new QLabel(QStringLiteral("Learning Rate:")),
                  createLearningRateBox(descent));
     form->addRow(new QLabel(QStringLiteral("Decay rate:")),
-                 createDecayBox(descent->decay_rate));
+                 createDecayBox(descent, &Hyperparameters::decay_rate));
 
     return createDescentGroup(plot_area->rms_prop.get(), form);
 }
@@ -256,17 +371,11 @@ QGroupBox *Window::createAdamGroup(){
     form->addRow(new QLabel(QStringLiteral("Learning Rate:")),
                  createLearningRateBox(descent));
     form->addRow(new QLabel(QStringLiteral("Beta1:")),
-                 createDecayBox(descent->beta1));
+                 createDecayBox(descent, &Hyperparameters::beta1));
     form->addRow(new QLabel(QStringLiteral("Beta2:")),
-                 createDecayBox(descent->beta2));
+                 createDecayBox(descent, &Hyperparameters::beta2));
 
-    QCheckBox *scaled = new QCheckBox( "Use Bias Correction" );
-    auto &bias_val = descent->use_bias_correction;
-    scaled->setChecked( bias_val );
-    QObject::connect( scaled, &QCheckBox::clicked, [&]( bool clicked ) {
-                bias_val = clicked;
-            } );
-    form->addRow( scaled );
+    form->addRow( createBiasCorrectionBox( descent ) );
 
     return createDescentGroup(plot_area->adam.get(), form);
 }
@@ -282,24 +391,18 @@ QGroupBox *Window::createQHAdamGroup()
             createLearningRateBox( descent ) );
     form->addRow(
             new QLabel( QStringLiteral( "Beta1:" ) ),
-            createDecayBox( descent->beta1 ) );
+            createDecayBox( descent, &Hyperparameters::beta1 ) );
     form->addRow(
             new QLabel( QStringLiteral( "Beta2:" ) ),
-            createDecayBox( descent->beta2 ) );
+            createDecayBox( descent, &Hyperparameters::beta2 ) );
     form->addRow(
             new QLabel( QStringLiteral( "Discount Factor:" ) ),
-            createDecayBox( descent->discount_factor ) );
+            createDecayBox( descent, &Hyperparameters::discount_factor ) );
     form->addRow(
             new QLabel( QStringLiteral( "Sq Discount Factor:" ) ),
-            createDecayBox( descent->squared_discount_factor ) );
+            createDecayBox( descent, &Hyperparameters::squared_discount_factor ) );
 
-    QCheckBox *scaled = new QCheckBox( "Use Bias Correction" );
-    auto &bias_val = descent->use_bias_correction;
-    scaled->setChecked( bias_val );
-    QObject::connect( scaled, &QCheckBox::clicked, [&]( bool clicked ) {
-                bias_val = clicked;
-            } );
-    form->addRow( scaled );
+    form->addRow( createBiasCorrectionBox( descent ) );
 
     return createDescentGroup( plot_area->qhadam.get(), form );
 }
@@ -310,12 +413,14 @@ QLayout *Window::createLearningRateBox(GradientDescent* descent){
 
     QSpinBox *learningRateBox = new QSpinBox(this);
     learningRateBox->setRange(-10, 10);
-    double x = log(descent->learning_rate) / log(10.);
+    double x = log(descent->publishedHyperparameters().learning_rate) / log(10.);
     learningRateBox->setValue(nearbyint(x));
     QObject::connect(learningRateBox,
         QOverload<int>::of(&QSpinBox::valueChanged),
         [=](const int &newValue) {
-            descent->learning_rate = pow(10, newValue);
+            Hyperparameters params = descent->publishedHyperparameters();
+            params.learning_rate = pow(10, newValue);
+            descent->publishHyperparameters(params);
         });
 
     hbox->addRow(new QLabel(QStringLiteral("1e")), learningRateBox);
@@ -325,18 +430,34 @@ QLayout *Window::createLearningRateBox(GradientDescent* descent){
 }
 
 
-QDoubleSpinBox *Window::createDecayBox(double& val){
+QDoubleSpinBox *Window::createDecayBox(GradientDescent* descent,
+                                       double Hyperparameters::* field){
     QDoubleSpinBox *decayRateBox = new QDoubleSpinBox(this);
     decayRateBox->setDecimals(3);
     decayRateBox->setRange(0.0, 2.0);
-    decayRateBox->setValue(val);
+    decayRateBox->setValue(descent->publishedHyperparameters().*field);
     decayRateBox->setSingleStep(0.1);
     QObject::connect(decayRateBox,
         QOverload<double>::of(&QDoubleSpinBox::valueChanged),
-        [&](const double &newValue ) {val = newValue;});
+        [=](const double &newValue ) {
+            Hyperparameters params = descent->publishedHyperparameters();
+            params.*field = newValue;
+            descent->publishHyperparameters(params);
+        });
     return decayRateBox;
 }
 
+QCheckBox *Window::createBiasCorrectionBox(GradientDescent* descent){
+    QCheckBox *scaled = new QCheckBox( "Use Bias Correction" );
+    scaled->setChecked( descent->publishedHyperparameters().use_bias_correction );
+    QObject::connect( scaled, &QCheckBox::clicked, [=]( bool clicked ) {
+                Hyperparameters params = descent->publishedHyperparameters();
+                params.use_bias_correction = clicked;
+                descent->publishHyperparameters( params );
+            } );
+    return scaled;
+}
+
 QTabWidget *Window::createViewTabs(){
     QTabWidget* tab = new QTabWidget;
     // TODO: say it's scaled down
@@ -361,6 +482,23 @@ QTabWidget *Window::createViewTabs(){
     QObject::connect(squaredGrad, &QCheckBox::clicked, plot_area, &PlotArea::setShowGradientSquared);
     QCheckBox* path = new QCheckBox("Path");
     QObject::connect(path, &QCheckBox::clicked, plot_area, &PlotArea::setShowPath);
+    QCheckBox* swarm = new QCheckBox("Particle Swarm");
+    swarm->setToolTip("Start every method from thousands of random points at once and\n"
+                      "watch the clouds spread over the surface.");
+    QObject::connect(swarm, &QCheckBox::clicked, plot_area, &PlotArea::setShowSwarm);
+
+    QComboBox* basinPicker = new QComboBox;
+    basinPicker->setToolTip("Start the method from every point of the surface and color each\n"
+                            "point by the minimum it ends up in. Darker means more steps;\n"
+                            "black means it did not converge.");
+    basinPicker->addItem("No basin map");
+    for (auto animation : plot_area->all_animations)
+        basinPicker->addItem(animation->name);
+    QObject::connect(basinPicker, SIGNAL(currentIndexChanged(QString)),
+                     plot_area, SLOT(showBasinMap(QString)));
+    QLabel* basinMessage = new QLabel;
+    QObject::connect(plot_area, &PlotArea::updateBasinMapMessage,
+                     basinMessage, &QLabel::setText);
 
 
     QWidget* overview_tab = new QWidget();
@@ -371,6 +509,9 @@ QTabWidget *Window::createViewTabs(){
     vbox->addWidget(momentum);
     vbox->addWidget(squaredGrad);
     vbox->addWidget(path);
+    vbox->addWidget(swarm);
+    vbox->addWidget(basinPicker);
+    vbox->addWidget(basinMessage);
     tab->addTab(overview_tab, "Overview");
 
     QComboBox* descentPicker = new QComboBox;
@@ -0,0 +1,171 @@
+// Checks that the vector kernels of BatchKernels update every descent method's
+// state as the scalar kernel does, on random batches over many steps. Kernels
+// the CPU can't run are skipped.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+
+#include "batch_descent.h"
+#include "batch_kernels.h"
+
+namespace {
+
+// the vector kernels do the scalar math operation for operation, so nothing
+// may differ
+const uint64_t kMaxUlps = 0;
+// not a multiple of either vector width, so the scalar tail runs too
+const size_t kNumBalls = 1003;
+const int kNumSteps = 20;
+const int kNumHyperparameterSets = 10;
+
+
+// how many doubles lie between a and b; 0 if both are NaN
+uint64_t ulpDistance(double a, double b){
+    if (isnan(a) || isnan(b)) return isnan(a) && isnan(b) ? 0 : UINT64_MAX;
+    int64_t ia, ib;
+    memcpy(&ia, &a, sizeof(a));
+    memcpy(&ib, &b, sizeof(b));
+    // order negative doubles below positive ones, -0 next to +0
+    if (ia < 0) ia = INT64_MIN - ia;
+    if (ib < 0) ib = INT64_MIN - ib;
+    return ia > ib ? uint64_t(ia) - uint64_t(ib) : uint64_t(ib) - uint64_t(ia);
+}
+
+
+// a gradient or moment of either sign over a wide range of magnitudes, now and
+// then exactly 0
+double randomValue(std::mt19937_64& random, bool non_negative = false){
+    std::uniform_real_distribution<double> exponent(-8., 4.);
+    if (random() % 16 == 0) return 0.;
+    double value = pow(10., exponent(random));
+    return non_negative || random() % 2 ? value : -value;
+}
+
+
+Hyperparameters randomHyperparameters(std::mt19937_64& random){
+    std::uniform_real_distribution<double> unit(0., 1.);
+    Hyperparameters h;
+    h.learning_rate = pow(10., -4. + 4. * unit(random));
+    h.decay_rate = 0.99 * unit(random);
+    h.discount_factor = unit(random);
+    h.squared_discount_factor = unit(random);
+    h.beta1 = 0.5 + 0.49 * unit(random);
+    h.beta2 = 0.9 + 0.0999 * unit(random);
+    h.use_bias_correction = random() % 2;
+    return h;
+}
+
+
+BatchState randomState(std::mt19937_64& random){
+    std::uniform_real_distribution<double> unit(0., 1.);
+    BatchState s;
+    s.resize(kNumBalls);
+    for (size_t i = 0; i < kNumBalls; i++){
+        s.delta_x[i] = randomValue(random);
+        s.delta_z[i] = randomValue(random);
+        s.first_moment_x[i] = randomValue(random);
+        s.first_moment_z[i] = randomValue(random);
+        s.second_moment_x[i] = randomValue(random, true);
+        s.second_moment_z[i] = randomValue(random, true);
+        s.beta1_pow[i] = unit(random);
+        s.beta2_pow[i] = unit(random);
+    }
+    return s;
+}
+
+
+// new gradients and convergence for the next step, the same in both states
+void randomizeStep(std::mt19937_64& random, BatchState& a, BatchState& b){
+    for (size_t i = 0; i < kNumBalls; i++){
+        a.grad_x[i] = b.grad_x[i] = randomValue(random);
+        a.grad_z[i] = b.grad_z[i] = randomValue(random);
+        a.converged[i] = b.converged[i] = random() % 4 == 0;
+    }
+}
+
+
+// prints the first difference beyond kMaxUlps and returns false if there is one
+bool compare(const char* field, const std::vector<double>& expected,
+             const std::vector<double>& actual, const char* label, int step){
+    for (size_t i = 0; i < expected.size(); i++){
+        if (ulpDistance(expected[i], actual[i]) > kMaxUlps){
+            printf("FAIL %s: step %d, ball %zu: %s is %.17g, scalar %.17g\n",
+                   label, step, i, field, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool compare(const BatchState& expected, const BatchState& actual,
+             const char* label, int step){
+    return compare("delta_x", expected.delta_x, actual.delta_x, label, step) &&
+           compare("delta_z", expected.delta_z, actual.delta_z, label, step) &&
+           compare("first_moment_x", expected.first_moment_x, actual.first_moment_x, label, step) &&
+           compare("first_moment_z", expected.first_moment_z, actual.first_moment_z, label, step) &&
+           compare("second_moment_x", expected.second_moment_x, actual.second_moment_x, label, step) &&
+           compare("second_moment_z", expected.second_moment_z, actual.second_moment_z, label, step) &&
+           compare("beta1_pow", expected.beta1_pow, actual.beta1_pow, label, step) &&
+           compare("beta2_pow", expected.beta2_pow, actual.beta2_pow, label, step);
+}
+
+
+// run one method with one instruction set against the scalar kernel
+bool checkKernel(Optimizer::OptimizerName optimizer_name,
+                 BatchKernels::InstructionSet instruction_set, std::mt19937_64& random){
+    char label[64];
+    snprintf(label, sizeof(label), "%s %s", Optimizer::name(optimizer_name),
+             BatchKernels::instructionSetName(instruction_set));
+
+    for (int set = 0; set < kNumHyperparameterSets; set++){
+        Hyperparameters h = randomHyperparameters(random);
+        BatchState expected = randomState(random);
+        BatchState actual = expected;
+        for (int step = 0; step < kNumSteps; step++){
+            randomizeStep(random, expected, actual);
+            BatchKernels::updateGradientDeltasScalar(optimizer_name, h, expected,
+                                                     0, kNumBalls);
+            size_t done = instruction_set == BatchKernels::avx512
+                    ? BatchKernels::updateGradientDeltasAvx512(optimizer_name, h, actual)
+                    : BatchKernels::updateGradientDeltasAvx2(optimizer_name, h, actual);
+            if (done == 0){
+                printf("FAIL %s: the vector kernel updated no balls\n", label);
+                return false;
+            }
+            BatchKernels::updateGradientDeltasScalar(optimizer_name, h, actual,
+                                                     done, kNumBalls);
+            if (!compare(expected, actual, label, step)) return false;
+        }
+    }
+    printf("ok   %s\n", label);
+    return true;
+}
+
+}
+
+
+int main(){
+    std::mt19937_64 random(1);
+    const BatchKernels::InstructionSet supported = BatchKernels::detectInstructionSet();
+    const BatchKernels::InstructionSet vector_sets[] = {BatchKernels::avx2,
+                                                        BatchKernels::avx512};
+    int failures = 0;
+    for (BatchKernels::InstructionSet instruction_set : vector_sets){
+        if (instruction_set > supported){
+            printf("skip %s: not supported by this CPU\n",
+                   BatchKernels::instructionSetName(instruction_set));
+            continue;
+        }
+        for (int o = 0; o < Optimizer::kNumOptimizers; o++){
+            if (!checkKernel(Optimizer::OptimizerName(o), instruction_set, random))
+                failures++;
+        }
+    }
+    if (failures > 0) printf("%d checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,13 @@
+# Checks of the simulation core; needs neither Qt nor a display. Exits with a
+# non-zero status if a check fails.
+# build and run with: qmake tests/tests.pro && make && ./gradient_descent_tests
+
+TEMPLATE = app
+TARGET = gradient_descent_tests
+
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+
+include(../core.pri)
+
+SOURCES += batch_kernels_test.cpp